@@ -0,0 +1,189 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#ifndef HX2A_INTERVIEWS_CONDITIONS_HPP
+#define HX2A_INTERVIEWS_CONDITIONS_HPP
+
+// Design notes:
+//
+// Transition conditions are arbitrary JavaScript, but in practice the vast majority of them are trivial, like:
+// qu2.choice.index == 2
+// age.input == "yes" && !colo
+// qu3.choices.length > 1
+// Running these through V8 means building source code, crossing into V8 and parsing back the result. This is done
+// for every answer of every interviewee, so it dominates the cost of running transitions.
+//
+// Conditions are therefore classified. The ones written in a small subset of JavaScript (literals, parameters, member
+// and index accesses, comparisons, boolean logic and negation) are compiled into a native expression tree, evaluated
+// directly against the JSON values of the answers. All the others are compiled once into a V8 function taking the
+// answers as arguments.
+//
+// The native evaluator never approximates JavaScript semantics. Whenever it meets a case where JavaScript would
+// perform a type coercion, throw, or look into a prototype, it gives up and the V8 function is run instead.
+//
+// Questions routing on many conditions (grids) would still cross into V8 once per condition. The V8 functions of the
+// conditions of a question are therefore also called from a single route function, taking the union of their
+// arguments once, and returning the position of the first transition whose condition is true. Transitions are still
+// tried in order, the first true one wins.
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "hx2a/json_value.hpp"
+
+namespace interviews {
+
+  using std::string;
+  using std::string_view;
+
+  using namespace hx2a;
+
+  class expression
+  {
+  public:
+
+    // The values of the parameters, in the same order as the parameter names supplied to compile.
+    using arguments = ::std::vector<json::value>;
+
+    // Returns an empty optional if the code is outside of the subset supported. The parameters are the only
+    // identifiers the code is allowed to refer to.
+    static ::std::optional<expression> compile(string_view code, const ::std::vector<string>& parameters);
+
+    // Returns the result of json::is_true on the value of the expression. Returns an empty optional if the
+    // evaluation cannot be performed natively with the exact JavaScript semantics. V8 must be used instead.
+    ::std::optional<bool> evaluate(const arguments&) const;
+
+    struct node;
+
+  private:
+
+    expression(::std::shared_ptr<const node> root):
+      _root(::std::move(root))
+    {
+    }
+
+    // Immutable once compiled, it can be shared across threads.
+    ::std::shared_ptr<const node> _root;
+  };
+
+  // A transition condition compiled once for a given key.
+  class compiled_condition
+  {
+  public:
+
+    compiled_condition(string function_name, string definition, ::std::optional<expression> e):
+      _function_name(::std::move(function_name)),
+      _definition(::std::move(definition)),
+      _expression(::std::move(e))
+    {
+    }
+
+    // The name of the V8 function. It takes the answers as arguments, in the order of the parameters. It must be
+    // defined in the calling thread before being called, see define.
+    const string& get_function_name() const { return _function_name; }
+
+    // Defines the V8 function in the heap of the calling thread, if not done yet.
+    void define() const;
+
+    // Null if the condition is outside of the natively supported subset.
+    const ::std::optional<expression>& get_expression() const { return _expression; }
+
+    bool is_native() const { return _expression.has_value(); }
+
+    void count_native_run() const { ++_native_runs; }
+
+    void count_v8_run() const { ++_v8_runs; }
+
+    // Runs close to the JavaScript budget, see javascript_budget.
+    void count_slow_run() const { ++_slow_runs; }
+
+    uint64_t get_native_runs() const { return _native_runs; }
+
+    uint64_t get_v8_runs() const { return _v8_runs; }
+
+    uint64_t get_slow_runs() const { return _slow_runs; }
+
+  private:
+
+    string _function_name;
+    // The JavaScript code defining the function.
+    string _definition;
+    ::std::optional<expression> _expression;
+    // Native runs that had to fall back on V8 are counted as V8 runs.
+    mutable ::std::atomic<uint64_t> _native_runs{0};
+    mutable ::std::atomic<uint64_t> _v8_runs{0};
+    mutable ::std::atomic<uint64_t> _slow_runs{0};
+  };
+
+  // The conditions of the transitions of a question, called from a single V8 function.
+  class compiled_route
+  {
+  public:
+
+    compiled_route(string function_name, string definition, ::std::vector<const compiled_condition*> conditions):
+      _function_name(::std::move(function_name)),
+      _definition(::std::move(definition)),
+      _conditions(::std::move(conditions))
+    {
+    }
+
+    // The name of the V8 function. Its arguments are the range of transition positions to try, first included and
+    // last excluded, followed by the union of the arguments of the conditions. It returns the position of the first
+    // transition in the range whose condition is true, in the json::is_true sense, or -1 if there is none.
+    const string& get_function_name() const { return _function_name; }
+
+    // Defines the V8 function, and the ones of the conditions it calls, in the heap of the calling thread, if not done
+    // yet.
+    void define() const;
+
+  private:
+
+    string _function_name;
+    // The JavaScript code defining the function.
+    string _definition;
+    ::std::vector<const compiled_condition*> _conditions;
+  };
+
+  // Conditions of locked questionnaires never change. Instead of injecting the arguments as variables in the condition
+  // source and having V8 compile it again at every run, each condition is compiled once, natively when possible, and
+  // into a global V8 function whose formal parameters are the question labels in all cases. Running a condition then
+  // only requires a call with the arguments.
+  // The registry is process-wide. It grows with the number of locked questionnaires versions run, which is small. Each
+  // thread keeps the conditions and routes it looked up in front of it, so that running transitions takes no lock. The
+  // V8 functions are defined in the heap of each thread the first time it calls them, so that the conditions do not
+  // depend on threads sharing a single V8 heap. Conditions evaluated natively are never defined again.
+  class compiled_conditions
+  {
+  public:
+
+    // Returns the compiled condition corresponding to the key, compiling it if necessary.
+    // The parameters must not contain duplicates.
+    static const compiled_condition& get(const string& key, const string& code, const ::std::vector<string>& parameters);
+
+    // Returns null if the condition was never run.
+    static const compiled_condition* find(const string& key);
+
+    struct route_condition
+    {
+      // The position of the transition in the question.
+      size_t _position;
+      const compiled_condition* _condition;
+      // The positions of the arguments of the condition in the union of the arguments of the route.
+      ::std::vector<size_t> _arguments;
+    };
+
+    // Returns the route corresponding to the key, compiling it if necessary. The conditions are the ones of the
+    // conditional transitions of a question, in order.
+    static const compiled_route& get_route(const string& key, const ::std::vector<route_condition>&);
+  };
+
+} // End namespace interviews.
+
+#endif
@@ -90,6 +90,9 @@ namespace interviews {
   using function_parameter_refers_to_self = exception_q<"funcpself", "Function parameter refers to the question bearing it.">;
   using function_parameter_refers_to_subsequent_question = exception_q<"funcpsubseq", "Function parameter refers to a subsequent question.">;
   
+  // JavaScript exceptions.
+  using javascript_budget_exceeded = exception_q<"jsbudget", "JavaScript evaluation exceeded its time budget.">;
+
   // Transitions exceptions.
   using transition_has_backwards_destination = exception_q<"trback", "Transition has backwards destination.">;
   using transition_has_both_condition_and_code = exception_q<"trhbcac", "Transition has both a condition and code specified.">;
@@ -107,6 +110,7 @@ namespace interviews {
   using question_loop_is_not_balanced = exception_q<"qlnotbal", "Question loop is not balanced.">;
   using question_loop_is_not_closed = exception_q<"qlnotcl", "Question loop is not closed.">;
   using question_loop_logic_error = exception_q<"qllerr", "Question loop logic error.">;
+  using question_loop_operand_is_too_large = exception_q<"qlopbig", "Question loop operand has too many elements.">;
   using question_loop_variable_unknown = exception_q<"qlvarun", "Question loop variable unknown.">;
   using question_must_not_have_a_comment = exception_q<"qcommmiss", "Question must not have a comment.">;
 
@@ -194,10 +198,12 @@ namespace interviews {
   using selection_is_invalid = exception<"sinv", "Selection is invalid.">;
 
   // Interview exceptions.
+  using interview_batch_is_too_large = exception<"intbatchtl", "Too many interviews requested at once.">;
   using interview_does_not_exist = exception<"intmiss", "Interview does not exist.">;
   using interview_is_already_completed = exception<"intcompl", "Interview is already completed.">;
   using interview_is_already_started = exception<"intalst", "Interview is already started.">;
   using interview_is_not_started = exception<"intnotst", "Interview is not started.">;
+  using interview_prepare_bulk_is_too_large = exception<"intbulktl", "Too many interviews to prepare at once.">;
 
   // Internal errors.
   using internal_error = exception<"ierr", "Internal error.">;
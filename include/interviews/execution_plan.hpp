@@ -0,0 +1,196 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#ifndef HX2A_INTERVIEWS_EXECUTION_PLAN_HPP
+#define HX2A_INTERVIEWS_EXECUTION_PLAN_HPP
+
+// Design notes:
+//
+// Once a campaign is created its questionnaire is locked, and its structure never changes. Still, running interviews
+// walks the questionnaire document at every request: scanning the list of questions to find a rank or a matching end
+// loop, and building the keys of the compiled transition conditions.
+//
+// An execution plan captures all of that once per questionnaire version (identifier and change count). It is immutable
+// and only holds values, no pointers to documents, which are loaded per request. So it can be shared freely across
+// threads. Plans are kept in a process-wide registry, evicting the least recently used ones beyond a memory bound. Each
+// thread keeps the few plans it uses in front of the registry, so that running interviews takes no lock. Threads still
+// stamp the last use of the plans they use, atomically, so that the eviction sees them.
+//
+// Plans are indexed by question ordinal. A questionnaire whose question ordinals do not match the question positions
+// (compiled before ordinals existed) gets no plan, and interviews run as before.
+//
+// Plans also hold the dependency graph of the questions: which transitions, text functions and loop operands use the
+// answer to which question, forward and reverse, as sets of ordinals. Answer revisions look it up to find whether a
+// history entry is impacted and whether transitions must run again, instead of scanning the parameter lists. As plans
+// are derived from locked questionnaires, the graph does not need to be persisted, and questionnaires compiled before
+// it existed get it too.
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "interviews/ontology.hpp"
+
+namespace interviews {
+
+  // A set of questions, as a bitset indexed by question ordinal. Most questions have no dependents, so the bitset only
+  // grows up to the highest ordinal inserted.
+  class question_set
+  {
+  public:
+
+    void insert(size_t ordinal){
+      size_t w = ordinal / word_bits;
+
+      if (w >= _words.size()){
+	_words.resize(w + 1, 0);
+      }
+
+      _words[w] |= word_type(1) << (ordinal % word_bits);
+    }
+
+    bool contains(size_t ordinal) const {
+      size_t w = ordinal / word_bits;
+      return w < _words.size() && ((_words[w] >> (ordinal % word_bits)) & 1);
+    }
+
+    bool intersects(const question_set& qs) const {
+      for (size_t i = 0, n = ::std::min(_words.size(), qs._words.size()); i != n; ++i){
+	if (_words[i] & qs._words[i]){
+	  return true;
+	}
+      }
+
+      return false;
+    }
+
+    size_t get_memory_size() const { return _words.size() * sizeof(word_type); }
+
+  private:
+
+    using word_type = uint64_t;
+
+    static constexpr size_t word_bits = 64;
+
+    ::std::vector<word_type> _words;
+  };
+
+  class execution_plan
+  {
+  public:
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct question_entry
+    {
+      string _label;
+      question::loop_type_t _loop_type;
+      // The number of loops enclosing the question. A begin loop is not enclosed by itself, neither is its end loop.
+      size_t _loop_depth;
+      // For a begin loop the ordinal of the matching end loop and conversely. npos for regular questions.
+      size_t _matching_loop;
+      // True for regular questions outside of loops and without text functions. They are presented the same way
+      // whatever the previous answers, so an answer to such a question remains valid whatever they become.
+      bool _context_free;
+      // The keys of the compiled conditions, one per transition, in order.
+      ::std::vector<string> _transition_keys;
+      // The ordinals of the transitions destinations, in order.
+      ::std::vector<size_t> _transition_destinations;
+      // The questions whose text functions or loop operand use the answer to this one.
+      question_set _impacted;
+      // The questions whose transitions use the answer to this one.
+      question_set _driven;
+      // Reverse of the above, the questions whose answers are used by the text functions, loop operand or transitions
+      // of this one.
+      question_set _dependencies;
+    };
+
+    // The questionnaire must be locked.
+    execution_plan(const questionnaire_r&);
+
+    const string& get_version_key() const { return _version_key; }
+
+    // False if the question ordinals of the questionnaire cannot be trusted.
+    bool is_valid() const { return _valid; }
+
+    size_t size() const { return _questions.size(); }
+
+    const question_entry& get_question(size_t ordinal) const {
+      HX2A_ASSERT(ordinal < _questions.size());
+      return _questions[ordinal];
+    }
+
+    // Returns npos if not found.
+    size_t find_ordinal(const string& label) const {
+      if (auto f = _ordinals_by_label.find(label); f != _ordinals_by_label.cend()){
+	return f->second;
+      }
+
+      return npos;
+    }
+
+    // Same as questionnaire::get_question_rank, without scanning.
+    size_t get_rank(size_t ordinal) const { return ordinal + 1; }
+
+    // Same as questionnaire::get_progress, without scanning.
+    progress_t get_progress(size_t ordinal) const {
+      if (_questions.empty()){
+	return 100;
+      }
+
+      return ((float)get_rank(ordinal) / (float)_questions.size()) * 100.0;
+    }
+
+    // Returns true if the text functions or the loop operand of the question with the second ordinal use the answer to
+    // the question with the first one. Same as question::is_impacted_by, without scanning.
+    bool is_impacted(size_t by, size_t ordinal) const {
+      return get_question(by)._impacted.contains(ordinal);
+    }
+
+    // Same with the transitions. Same as question::is_driven_by, without scanning.
+    bool is_driven(size_t by, size_t ordinal) const {
+      return get_question(by)._driven.contains(ordinal);
+    }
+
+    // Returns true if the text functions, the loop operand or the transitions of the question use the answer to one of
+    // the questions given.
+    bool depends_on_any(size_t ordinal, const question_set& qs) const {
+      return get_question(ordinal)._dependencies.intersects(qs);
+    }
+
+    bool is_context_free(size_t ordinal) const {
+      return get_question(ordinal)._context_free;
+    }
+
+    // Approximate memory footprint, in bytes.
+    size_t get_memory_size() const { return _memory_size; }
+
+  private:
+
+    string _version_key;
+    bool _valid;
+    // Indexed by ordinal.
+    ::std::vector<question_entry> _questions;
+    ::std::unordered_map<string, size_t> _ordinals_by_label;
+    size_t _memory_size;
+  };
+
+  class execution_plans
+  {
+  public:
+
+    // Returns the plan for the current version of the questionnaire, building it if necessary. Returns null if the
+    // questionnaire is not locked or if its plan is not valid.
+    // Least recently used plans are evicted beyond an approximate memory bound. A plan in use is never destroyed, its
+    // users share its ownership, and so do the threads which used it recently.
+    static ::std::shared_ptr<const execution_plan> get(const questionnaire_r&);
+  };
+
+} // End namespace interviews.
+
+#endif
@@ -0,0 +1,75 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#ifndef HX2A_INTERVIEWS_LOOP_OPERAND_HPP
+#define HX2A_INTERVIEWS_LOOP_OPERAND_HPP
+
+// Design notes:
+//
+// The operand of a begin loop is JavaScript code assigning to R the vector to iterate upon, from the localized answer
+// to the operand question. In most cases it is merely a path into that answer, like R=hh.choices. Running V8 for that
+// means serializing the answer into source code, compiling it and parsing back the result.
+//
+// Operands are therefore parsed once, and the ones made of member and index accesses rooted at the operand question
+// are applied natively to the localized answer. As for transition conditions, the native application never
+// approximates JavaScript semantics. Whenever JavaScript would throw or look into a prototype, V8 runs the operand
+// instead. Parsed operands are immutable and shared, they are registered process-wide by operand, and each thread keeps
+// the ones it uses in front of the registry.
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "interviews/misc.hpp"
+
+namespace interviews {
+
+  using std::string;
+  using std::string_view;
+
+  class loop_operand_path
+  {
+  public:
+
+    struct step
+    {
+      // Empty for index accesses.
+      string _member;
+      size_t _index;
+    };
+
+    using steps_type = ::std::vector<step>;
+
+    // Returns an empty optional if the operand is not a path.
+    static ::std::optional<loop_operand_path> parse(string_view operand);
+
+    // The identifier the path starts from. The path can be applied natively only if it is the label of the operand
+    // question.
+    const string& get_root() const { return _root; }
+
+    const steps_type& get_steps() const { return _steps; }
+
+    // Returns the value assigned to R, null if it is undefined. Returns an empty optional if the path cannot be applied
+    // natively with the exact JavaScript semantics. V8 must be used instead.
+    ::std::optional<json::value> apply(const json::value& root) const;
+
+  private:
+
+    string _root;
+    steps_type _steps;
+  };
+
+  class loop_operand_paths
+  {
+  public:
+
+    // Returns the path, parsing the operand if necessary. Returns null if the operand is not a path.
+    static const loop_operand_path* get(const string& operand);
+  };
+
+} // End namespace interviews.
+
+#endif
@@ -7,6 +7,7 @@
 #define HX2A_INTERVIEWS_MISC_HPP
 
 #include <array>
+#include <chrono>
 #include <string>
 
 #include "hx2a/json_value.hpp"
@@ -174,21 +175,74 @@ function itvSelected(options, choices){
   
   constexpr char dbname[] = "idb";
 
-  // Dummy returned value to be able to call initialize in a static variable in a function.
+  // Loads the JavaScript library in the V8 heap of the calling thread, once per thread. Nothing relies on threads
+  // sharing a single heap.
   bool initialize();
 
   // This calls initialize, use it.
   inline json::value v8_execute(string_view s){
-    [[maybe_unused]] static bool init = initialize();
+    [[maybe_unused]] static thread_local bool init = initialize();
     return v8::execute(s);
   }
 
   template <typename SlotJSType>
   inline json::value slot_js_run(SlotJSType& sjs){
-    [[maybe_unused]] static bool init = initialize();
+    [[maybe_unused]] static thread_local bool init = initialize();
     return sjs.run();
   }
 
+  // Questionnaire JavaScript (conditions, text functions and loop operands) runs in the request thread, and V8 cannot
+  // be interrupted from here. Each V8 call is timed instead. Calls taking more than half of the budget are close to it,
+  // they are counted per condition or logged, so that designers can fix the questionnaire before launch. Calls over the
+  // budget are logged as errors. They fail the request naming the question only when moving ahead after a new answer,
+  // see enforcement. Replays and read requests never fail, otherwise the same interview would fail again every time.
+  class javascript_budget
+  {
+  public:
+
+    using clock = ::std::chrono::steady_clock;
+
+    enum status_t {
+		   within,
+		   close,
+		   exceeded
+    };
+
+    // Questionnaire JavaScript is usually a few expressions, running in well under a millisecond.
+    static constexpr clock::duration budget = ::std::chrono::milliseconds(50);
+
+    // Returns the status of the call started at the time given.
+    static status_t check(clock::time_point start);
+
+    // While an instance exists, calls over the budget in the thread throw javascript_budget_exceeded. The answer
+    // failing with the request is not recorded, so the interview is never replayed through the call.
+    class enforcement
+    {
+    public:
+
+      enforcement():
+	_previous(_enforced)
+      {
+	_enforced = true;
+      }
+
+      ~enforcement(){
+	_enforced = _previous;
+      }
+
+      enforcement(const enforcement&) = delete;
+
+      enforcement& operator=(const enforcement&) = delete;
+
+      static bool is_enforced(){ return _enforced; }
+
+    private:
+
+      inline static thread_local bool _enforced = false;
+      bool _previous;
+    };
+  };
+
 } // End namespace interviews.
 
 #endif
@@ -22,7 +22,10 @@
 // It means that a message in the middle of a questionnaire, if it has no explicit transition, always automatically
 // switches to the next question.
 
+#include <algorithm>
+#include <cstdint>
 #include <iterator>
+#include <limits>
 #include <optional>
 #include <stack>
 #include <unordered_map>
@@ -350,10 +353,45 @@ namespace interviews {
   using entry_end_loop_p = ptr<entry_end_loop>;
   using entry_end_loop_r = rfr<entry_end_loop>;
 
+  class stack_snapshot_frame;
+  using stack_snapshot_frame_p = ptr<stack_snapshot_frame>;
+  using stack_snapshot_frame_r = rfr<stack_snapshot_frame>;
+
+  class stack_snapshot;
+  using stack_snapshot_p = ptr<stack_snapshot>;
+  using stack_snapshot_r = rfr<stack_snapshot>;
+
   class interview;
   using interview_p = ptr<interview>;
   using interview_r = rfr<interview>;
 
+  class interview_log;
+  using interview_log_p = ptr<interview_log>;
+  using interview_log_r = rfr<interview_log>;
+
+  class rank_statistics;
+  using rank_statistics_p = ptr<rank_statistics>;
+  using rank_statistics_r = rfr<rank_statistics>;
+
+  class option_statistics;
+  using option_statistics_p = ptr<option_statistics>;
+  using option_statistics_r = rfr<option_statistics>;
+
+  class question_statistics;
+  using question_statistics_p = ptr<question_statistics>;
+  using question_statistics_r = rfr<question_statistics>;
+
+  class campaign_statistics;
+  using campaign_statistics_p = ptr<campaign_statistics>;
+  using campaign_statistics_r = rfr<campaign_statistics>;
+
+  // Not persistent, see execution_plan.hpp.
+  class execution_plan;
+  class question_set;
+
+  // Not persistent, see statistics.hpp.
+  class statistics_delta;
+
   class the_stack;
     
   // A template localization does not have any link to the question from template. We carry both.
@@ -545,10 +583,28 @@ namespace interviews {
       return clone(*_destination);
     }
 
+    // Returns the key identifying a transition by its position in a question of a given questionnaire version, for
+    // process-wide caches of compiled conditions. Returns an empty key if the questionnaire key is empty.
+    static string make_key(const string& questionnaire_key, const string& question_label, size_t position){
+      if (questionnaire_key.empty()){
+	return {};
+      }
+
+      // The label is unique in the questionnaire, the position of the transition is unique in the question.
+      return questionnaire_key + '/' + question_label + '/' + ::std::to_string(position);
+    }
+    
+    // The questions the condition uses, without duplicates, in order. They are the formal parameters of its compiled
+    // function.
+    ::std::vector<const question*> get_distinct_parameters() const;
+
     // Transitions are not allowed to use the language.
     // Returns a non null question smart pointer when the transition is valid.
+    // Injects the arguments in the condition source, for questionnaires without an execution plan. Otherwise the
+    // conditions of the question are compiled and run together, see question::run_transitions.
+    // The question label is only used to report runs over the JavaScript budget.
     // Cannot be const.
-    question_p run(const the_stack&, time_t start_timestamp);
+    question_p run(const the_stack&, time_t start_timestamp, const string& start_ip_address, const string& question_label);
 
     void check_condition() const {
       HX2A_ASSERT(_condition);
@@ -557,8 +613,7 @@ namespace interviews {
 
     // Returns true of the question is in the parameters.
     bool is_driven_by(const question_r& q) const {
-      HX2A_ASSERT(_condition);
-      return _condition->uses_as_parameter(q);
+      return _condition && _condition->uses_as_parameter(q);
     }
 
   private:
@@ -941,6 +996,7 @@ namespace interviews {
   {
     HX2A_ANCHOR(question, type_tag<"q">, anchor,
 		((_label, "l"),
+		 (_ordinal, "o"),
 		 (_transitions, "t")));
   public:
 
@@ -958,6 +1014,7 @@ namespace interviews {
     // [a-zA-Z$][0-9a-zA-Z_$]*
     question(const string& label):
       _label(*this, label),
+      _ordinal(*this, 0),
       _transitions(*this)
     {
       if (!validate_label(label)){
@@ -979,6 +1036,13 @@ namespace interviews {
 
     const string& get_label() const { return _label; }
 
+    // The position of the question in its questionnaire, from 0. Dense, it allows indexing answers by question in
+    // vectors rather than in maps.
+    size_t get_ordinal() const { return _ordinal; }
+
+    // Called by the questionnaire when the question is added.
+    void set_ordinal(size_t o){ _ordinal = o; }
+
     // Dummy body.
     virtual string get_style() const {
       HX2A_ASSERT(false);
@@ -1000,7 +1064,8 @@ namespace interviews {
     }
 
     // Returns the optional next question, after running transitions.
-    question_r run_transitions(const the_stack&, time_t start_timestamp) const;
+    // The execution plan of the questionnaire, if any, supplies the keys allowing to reuse compiled conditions.
+    question_r run_transitions(const the_stack&, time_t start_timestamp, const string& start_ip_address, const execution_plan* = nullptr) const;
 
     void check_conditions() const {
       for (const auto& t: _transitions){
@@ -1068,6 +1133,7 @@ namespace interviews {
   private:
 
     slot<string> _label;
+    slot<size_t> _ordinal;
     // Even if the source does not have any transitions, a catch-all transition will be
     // added with an empty condition. It'll transition to the next question.
     transitions_type _transitions;
@@ -1322,13 +1388,39 @@ namespace interviews {
     // The label is the template name.
     static template_question_p find(const db::connector& c, const string& label);
 
+    // See template_question_localization::find. Returns null if the localization was not found yet with this document,
+    // or with a former cache version.
+    template_question_localization_p find_memoized_localization(language_t lang, uint64_t version) const {
+      for (const auto& ml: _memoized_localizations){
+	if (ml._language == lang && ml._version == version){
+	  return ml._localization;
+	}
+      }
+
+      return {};
+    }
+
+    void memoize_localization(language_t lang, uint64_t version, const template_question_localization_r& tql) const {
+      _memoized_localizations.push_back({lang, version, tql});
+    }
+
   private:
 
+    struct memoized_localization
+    {
+      language_t _language;
+      uint64_t _version;
+      template_question_localization_p _localization;
+    };
+
     link<template_question_category> _category;
     // The label is the template unique name.
     slot<string> _label;
     // There is no need for a specific template question body, we can reuse the regular question body.
     own<question_body> _body;
+    // Not persistent. The localizations found for this document, usually a single one, so that rendering the question
+    // several times in a request looks them up once.
+    mutable ::std::vector<memoized_localization> _memoized_localizations;
   };
 
   // A questionnaire is automatically locked when a campaign is created.
@@ -1336,7 +1428,7 @@ namespace interviews {
   // Clone the questionnaire and perform modifications in case modifications are necessary.
   class questionnaire: public root<>
   {
-    HX2A_ROOT(questionnaire, type_tag<"qq">, 1.1, root,
+    HX2A_ROOT(questionnaire, type_tag<"qq">, 1.2, root,
 	      ((_code, "c"),
 	       (_name, "n"),
 	       (_logo, "l"),
@@ -1416,9 +1508,14 @@ namespace interviews {
     }
 
     unsigned int get_change_count() const { return _change_count; }
+
+    // Returns a key identifying this version of the questionnaire, to be used by process-wide caches of compiled
+    // artifacts. The key is empty when the questionnaire is not locked, as it can still change.
+    string get_version_key() const;
     
     void push_question_back(const question_r& q){
       check_lock();
+      q->set_ordinal(_questions.size());
       _questions.push_back(q);
       touch();
     }
@@ -1508,20 +1605,28 @@ namespace interviews {
     slot<bool> _locked;
     // Meant for instance to avoid spending time checking a localization if it has already been checked.
     slot<unsigned int> _change_count;
+    // Not persistent. See get_version_key.
+    mutable string _version_key;
   };
 
   // Aka "project".
+  // Versions:
+  // - 1.1 adds the statistics counters documents ("st"). Older documents decode with none, their statistics are not
+  //   maintained.
   class campaign: public root<>
   {
-    HX2A_ROOT(campaign, type_tag<"camp">, 1, root,
+    HX2A_ROOT(campaign, type_tag<"camp">, 1.1, root,
 	      ((_name, "n"),
 	       (_questionnaire, "q"),
 	       (_start, "s"),
 	       (_duration, "d"),
 	       (_interview_lifespan, "il"),
-	       (_end, "e")));
+	       (_end, "e"),
+	       (_statistics, "st")));
   public:
 
+    using statistics_type = link_list<campaign_statistics>;
+
     // A 0 start means that the campaign starts immediately.
     // A 0 duration means that the campagn is unlimited in duration.
     // Creating a campaign checks the questionnaire (in particular that it no has orphans) if it was never locked.
@@ -1538,7 +1643,8 @@ namespace interviews {
       _start(*this, start),
       _duration(*this, duration),
       _interview_lifespan(*this, interview_lifespan),
-      _end(*this)
+      _end(*this),
+      _statistics(*this)
     {
       // We defer the check to the moment the campaign is created to offer some slack for survey designers.
       q->check();
@@ -1586,6 +1692,17 @@ namespace interviews {
       _interview_lifespan = interview_lifespan;
       _end = start + duration;
     }
+
+    // The counters documents, see statistics.hpp. Created with the campaign.
+    statistics_type::const_iterator statistics_cbegin() const { return _statistics.cbegin(); }
+
+    statistics_type::const_iterator statistics_cend() const { return _statistics.cend(); }
+
+    size_t statistics_size() const { return _statistics.size(); }
+
+    void push_statistics_back(const campaign_statistics_r& cs){
+      _statistics.push_back(cs);
+    }
     
   private:
 
@@ -1595,6 +1712,7 @@ namespace interviews {
     slot<time_t> _duration;
     slot<time_t> _interview_lifespan;
     slot<time_t> _end;
+    statistics_type _statistics;
   };
 
   // Localization.
@@ -2103,7 +2221,10 @@ namespace interviews {
     
     language_t get_language() const { return _language; }
 
+    // All the updates of a template question localization go through here, the language being optional.
     void update_language(language_t l){
+      invalidate_cache();
+      
       if (l != language::nil()){
 	// An attempt is made to change the language of the localization. Let's see if one already exists or not
 	// before proceeding.
@@ -2149,8 +2270,15 @@ namespace interviews {
       return _body->make_localized_question(label, ts, lang, logo, title, q, progress);
     }
 
+    // Template question localizations found are remembered process-wide, so that rendering a question from template does
+    // not query an index every time. They are also memoized on the template question document, so that the following
+    // renders in the same request involve neither the process-wide cache nor the database.
     static template_question_localization_p find(const template_question_r&, language_t);
 
+    // Must be called whenever a template question localization is updated. Template question localizations cannot be
+    // removed, except by referential integrity, which is detected by find.
+    static void invalidate_cache();
+
   private:
 
     link<template_question> _template_question;
@@ -2219,6 +2347,7 @@ namespace interviews {
     // Beware it is caller's responsibility to call check whenever necessary.
     void push_question_localization_back(const question_localization_r& ql){
       _questions_localizations.push_back(ql);
+      _indexed = false;
     }
 
     questions_localizations_type::const_iterator questions_localizations_cbegin() const {
@@ -2232,8 +2361,22 @@ namespace interviews {
     // Assumes that check has been called.
     void dump(questionnaire_localization_map_per_question&) const;
     
-    // Prefer the map above if scanning the entire questionnaire localization.
+    // Constant time, through an index by question ordinal.
     question_localization_p find_question_localization(const question_r& q) const {
+      if (index()){
+	size_t o = q->get_ordinal();
+
+	if (o >= _index.size() || !_index[o]){
+	  return {};
+	}
+
+	// Belt and suspenders, the question must match.
+	if (_index[o]->get_question() == q){
+	  return _index[o];
+	}
+      }
+
+      // The question ordinals cannot be trusted, scanning.
       auto i = std::find_if(_questions_localizations.cbegin(), _questions_localizations.cend(),
 			    [&](const question_localization_p& if_ql){
 			      HX2A_ASSERT(if_ql);
@@ -2257,6 +2400,11 @@ namespace interviews {
 
   private:
 
+    // Builds the index if it is missing. Returns false if it cannot be built because the questionnaire is not locked,
+    // or because the question ordinals are not consistent, which happens with questionnaires compiled before ordinals
+    // existed. Lookups then scan.
+    bool index() const;
+
     // Strong link, localizations will be removed automatically when a questionnaire is removed.
     link<questionnaire> _questionnaire;
     slot<unsigned int> _questionnaire_change_count;
@@ -2265,6 +2413,12 @@ namespace interviews {
     slot<language_t> _language;
     slot<string> _name;
     questions_localizations_type _questions_localizations;
+    // Not persistent. The question localizations per question ordinal, null for questions without localization (e.g.,
+    // questions from template), empty if lookups scan. It is built with a single walk of the question localizations,
+    // from the ordinals registered process-wide for the localization version. Raw pointers, as the question
+    // localizations are owned by this.
+    mutable ::std::vector<question_localization*> _index;
+    mutable bool _indexed = false;
   };
 
   // Interview.
@@ -2318,11 +2472,19 @@ namespace interviews {
     }
 
     // Dummy definition.
-    virtual answer_data_r make_answer_data(const answer_r&, time_t start_timestamp) const;
+    virtual answer_data_r make_answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address) const;
     
     // Dummy definition.
     virtual localized_answer_data_r make_localized_answer_data(const string& label, const the_stack&, language_t, const question_body_r&, const question_localization_body_r&) const;
 
+    // The two functions below build directly the JSON values JavaScript code receives, without building payloads, serializing them
+    // and parsing them back. They must produce exactly the same members as make_answer_data and make_localized_answer_data
+    // respectively, without the polymorphic type tag.
+    // The object given already contains the members common to all answers.
+    
+    virtual void make_json_body(json::object_type&) const {}
+
+    virtual void make_localized_json_body(json::object_type&, const question_localization_body_r&) const {}
   };
 
   // Contrary to intuition, there is an answer to message, although there is no input to submit. An interstitial message can
@@ -2338,7 +2500,7 @@ namespace interviews {
     {
     }
     
-    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp) const override;
+    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address) const override;
     
     localized_answer_data_r make_localized_answer_data(const string& label, const the_stack&, language_t, const question_body_r&, const question_localization_body_r&) const override;
   };
@@ -2356,6 +2518,10 @@ namespace interviews {
 
     const string& get_comment() const { return _comment; }
 
+    void make_json_body(json::object_type&) const override;
+
+    void make_localized_json_body(json::object_type&, const question_localization_body_r&) const override;
+
   private:
     
     slot<string> _comment; 
@@ -2373,9 +2539,13 @@ namespace interviews {
     {
     }
 
-    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp) const override;
+    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address) const override;
     
     localized_answer_data_r make_localized_answer_data(const string& label, const the_stack&, language_t, const question_body_r&, const question_localization_body_r&) const override;
+
+    void make_json_body(json::object_type&) const override;
+
+    void make_localized_json_body(json::object_type&, const question_localization_body_r&) const override;
     
   private:
     
@@ -2393,6 +2563,9 @@ namespace interviews {
     
     // Adds options to the argument.
     void shared_add_options_to_localized_answer_data(const question_localization_body_with_options_r&, const localized_answer_data_with_options_r&) const;
+
+    // Adds the options.
+    void make_localized_json_body(json::object_type&, const question_localization_body_r&) const override;
   };
   
   class answer_body_select: public answer_body_with_options
@@ -2412,9 +2585,13 @@ namespace interviews {
       return *_choice;
     }
 
-    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp) const override;
+    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address) const override;
     
     localized_answer_data_r make_localized_answer_data(const string& label, const the_stack&, language_t, const question_body_r&, const question_localization_body_r&) const override;
+
+    void make_json_body(json::object_type&) const override;
+
+    void make_localized_json_body(json::object_type&, const question_localization_body_r&) const override;
     
   private:
     
@@ -2448,6 +2625,12 @@ namespace interviews {
     // Adds options AND choices to the argument.
     void shared_add_options_to_localized_answer_data(const question_localization_body_with_options_r&, const localized_answer_data_multiple_choices_r&) const;
 
+    // The JSON bodies are the same for all the multiple choices answers.
+    
+    void make_json_body(json::object_type&) const override;
+
+    void make_localized_json_body(json::object_type&, const question_localization_body_r&) const override;
+
   private:
     
     choices_type _choices;
@@ -2463,7 +2646,7 @@ namespace interviews {
 
     // No need for a specific make json body.
     
-    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp) const override;
+    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address) const override;
     
     localized_answer_data_r make_localized_answer_data(const string& label, const the_stack&, language_t, const question_body_r&, const question_localization_body_r&) const override;
   };
@@ -2478,7 +2661,7 @@ namespace interviews {
     
     // No need for a specific make json body.
     
-    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp) const override;
+    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address) const override;
     
     localized_answer_data_r make_localized_answer_data(const string& label, const the_stack&, language_t, const question_body_r&, const question_localization_body_r&) const override;
   };
@@ -2493,7 +2676,7 @@ namespace interviews {
     
     // No need for a specific make json body.
     
-    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp) const override;
+    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address) const override;
     
     localized_answer_data_r make_localized_answer_data(const string& label, const the_stack&, language_t, const question_body_r&, const question_localization_body_r&) const override;
   };
@@ -2508,7 +2691,7 @@ namespace interviews {
     
     // No need for a specific make json body.
     
-    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp) const override;
+    answer_data_r make_answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address) const override;
     
     localized_answer_data_r make_localized_answer_data(const string& label, const the_stack&, language_t, const question_body_r&, const question_localization_body_r&) const override;
   };
@@ -2523,6 +2706,7 @@ namespace interviews {
 		 (_template_question_localization, "tql"),
 		 (_question_from_template, "qft"),
 		 (_ip_address, "ip"),
+		 (_ip_address_is_start, "ips"),
 		 (_elapsed, "e"),
 		 (_total_elapsed, "te"),
 		 (_geolocation, "g"),
@@ -2534,6 +2718,7 @@ namespace interviews {
       _template_question_localization(*this),
       _question_from_template(*this),
       _ip_address(*this, ip_address),
+      _ip_address_is_start(*this, false),
       _elapsed(*this, elapsed),
       _total_elapsed(*this, total_elapsed),
       _geolocation(*this, geo),
@@ -2546,6 +2731,7 @@ namespace interviews {
       _template_question_localization(*this, tql),
       _question_from_template(*this, qft),
       _ip_address(*this, ip_address),
+      _ip_address_is_start(*this, false),
       _elapsed(*this, elapsed),
       _total_elapsed(*this, total_elapsed),
       _geolocation(*this, geo),
@@ -2582,13 +2768,31 @@ namespace interviews {
       return *_question_from_template;
     }
 
-    const string& get_ip_address() const { return _ip_address; }
+    // The IP address is not stored when it is the one the interview was started from, which is the case of most
+    // answers. Same principle as the timestamp. A flag tells it apart from an IP address which is genuinely empty.
+    const string& get_ip_address(const string& interview_start_ip_address) const {
+      return _ip_address_is_start ? interview_start_ip_address : _ip_address.get();
+    }
+
+    // Called when the answer is recorded in the interview.
+    void intern_ip_address(const string& interview_start_ip_address){
+      if (!interview_start_ip_address.empty() && _ip_address.get() == interview_start_ip_address){
+	_ip_address = string{};
+	_ip_address_is_start = true;
+      }
+    }
 
     time_t get_elapsed() const { return _elapsed; }
 
     time_t get_total_elapsed() const { return _total_elapsed; }
 
     time_t get_timestamp(time_t interview_start_timestamp) const { return interview_start_timestamp + _total_elapsed; }
+
+    // When the answer is recorded again, see interview::regraft_stashed_answers.
+    void set_elapsed_times(time_t elapsed, time_t total_elapsed){
+      _elapsed = elapsed;
+      _total_elapsed = total_elapsed;
+    }
     
     geolocation_p get_geolocation() const { return _geolocation; }
 
@@ -2597,9 +2801,9 @@ namespace interviews {
       return *_body;
     }
     
-    answer_data_r make_answer_data(time_t start_timestamp) const {
+    answer_data_r make_answer_data(time_t start_timestamp, const string& start_ip_address) const {
       HX2A_ASSERT(_body);
-      return _body->make_answer_data(*this, start_timestamp);
+      return _body->make_answer_data(*this, start_timestamp, start_ip_address);
     }
 
     // The localized answer data is calculated with the localization the interview was taken in.
@@ -2615,6 +2819,12 @@ namespace interviews {
       return _body->make_localized_answer_data(_question_from_template->get_label(), ts, lang, _question_from_template->get_body(), _template_question_localization->get_body());
     }
 
+    // Same as make_answer_data, but directly building the untagged JSON value injected in JavaScript code.
+    json::value make_answer_value(time_t start_timestamp, const string& start_ip_address) const;
+
+    // Same as make_localized_answer_data, but directly building the untagged JSON value injected in JavaScript code.
+    json::value make_localized_answer_value(const the_stack&, language_t) const;
+
     // The localized answer data is calculated with the imposed localization, which might be different from the one the
     // interview was taken in.
     localized_answer_data_r make_localized_answer_data(const the_stack& ts, language_t lang, const question_localization_r& ql) const {
@@ -2640,6 +2850,8 @@ namespace interviews {
     link<question_from_template> _question_from_template;
 
     slot<string> _ip_address;
+    // When true, the IP address is the interview start one and is not stored.
+    slot<bool> _ip_address_is_start;
     slot<time_t> _elapsed;
     slot<time_t> _total_elapsed;
     // There is a timestamp in the geolocation.
@@ -2784,34 +2996,151 @@ namespace interviews {
     link<question_end_loop> _question_end_loop;
   };
   
+  // Persisted image of a stack frame. See stack_snapshot below.
+  class stack_snapshot_frame: public element<>
+  {
+    HX2A_ELEMENT(stack_snapshot_frame, type_tag<"stack_frame">, element,
+		 ((_question_begin_loop, "qbl"),
+		  (_loop_operand_answer, "loa"),
+		  (_loop_operand, "lo"),
+		  (_loop_operand_language, "l"),
+		  (_index, "i"),
+		  (_answers, "a")));
+  public:
+
+    using answers_type = link_list<answer>;
+
+    stack_snapshot_frame(const question_begin_loop_r& qbl, const answer_r& loa, const string& loop_operand, language_t loop_operand_language, size_t index):
+      _question_begin_loop(*this, qbl),
+      _loop_operand_answer(*this, loa),
+      _loop_operand(*this, loop_operand),
+      _loop_operand_language(*this, loop_operand_language),
+      _index(*this, index),
+      _answers(*this)
+    {}
+
+    question_begin_loop_r get_question_begin_loop() const {
+      HX2A_ASSERT(_question_begin_loop);
+      return *_question_begin_loop;
+    }
+
+    answer_r get_loop_operand_answer() const {
+      HX2A_ASSERT(_loop_operand_answer);
+      return *_loop_operand_answer;
+    }
+
+    const string& get_loop_operand() const { return _loop_operand.get(); }
+
+    language_t get_loop_operand_language() const { return _loop_operand_language; }
+
+    size_t get_index() const { return _index; }
+
+    answers_type::const_iterator answers_cbegin() const { return _answers.cbegin(); }
+
+    answers_type::const_iterator answers_cend() const { return _answers.cend(); }
+
+    void push_answer_back(const answer_r& a){
+      _answers.push_back(a);
+    }
+
+  private:
+
+    link<question_begin_loop> _question_begin_loop;
+    // Weak for the same reason as on the entry begin loop.
+    weak_link<answer> _loop_operand_answer;
+    // The loop operand is calculated by V8 once, when the loop starts. We keep it serialized so that it is never
+    // calculated again.
+    slot<string> _loop_operand;
+    // The language the loop operand was calculated in, as it uses localized answers. Nil if unknown, the operand is then
+    // calculated again before the loop variable is used.
+    slot<language_t> _loop_operand_language;
+    slot<size_t> _index;
+    answers_type _answers;
+  };
+
+  // Persisted image of the stack after the first entries of the history of an interview. Rebuilding the stack from
+  // the whole history at every request requires running V8 again for every loop operand encountered. With the
+  // snapshot, only the entries added after it are replayed.
+  class stack_snapshot: public element<>
+  {
+    HX2A_ELEMENT(stack_snapshot, type_tag<"stack">, element,
+		 ((_history_size, "hs"),
+		  (_answers, "a"),
+		  (_frames, "f")));
+  public:
+
+    using answers_type = link_list<answer>;
+    using frames_type = own_list<stack_snapshot_frame>;
+
+    stack_snapshot(size_t history_size):
+      _history_size(*this, history_size),
+      _answers(*this),
+      _frames(*this)
+    {}
+
+    // The number of history entries the stack was calculated from.
+    size_t get_history_size() const { return _history_size; }
+
+    answers_type::const_iterator answers_cbegin() const { return _answers.cbegin(); }
+
+    answers_type::const_iterator answers_cend() const { return _answers.cend(); }
+
+    frames_type::const_iterator frames_cbegin() const { return _frames.cbegin(); }
+
+    frames_type::const_iterator frames_cend() const { return _frames.cend(); }
+
+    void push_answer_back(const answer_r& a){
+      _answers.push_back(a);
+    }
+
+    void push_frame_back(const stack_snapshot_frame_r& f){
+      _frames.push_back(f);
+    }
+
+  private:
+
+    slot<size_t> _history_size;
+    // Top level answers, without a loop nest.
+    answers_type _answers;
+    // Outermost nest first.
+    frames_type _frames;
+  };
+  
   class the_stack_frame
   {
   public:
     
-    // Indexes all answers by question. Indexing by question pointer is more efficient that by
-    // question label.
-    // This is for conditions and parametric texts evaluation.
-    // Because of loops there might be several answers for the same question. We keep only the
-    // last one.
-    using answers_by_question_map = std::unordered_map<const question*, answer_p>;
+    // The answers recorded in a loop nest hide the answers to the same questions in the enclosing nests. The stack only
+    // indexes the visible answers. Each frame records what its answers hid, so that they can be made visible again when
+    // the frame is popped. Loop bodies are short, a vector is all we need.
+    struct shadowed_answer
+    {
+      // The position of the question in the stack, see the_stack::get_position.
+      size_t _position;
+      // Null if there was no answer to the question in the enclosing nests.
+      answer_p _answer;
+    };
+
+    using shadowed_answers_type = ::std::vector<shadowed_answer>;
+
+    // Loop operands are kept in memory and snapshotted with the stack, so they are bounded. The bound is enforced when a
+    // loop starts, see interview::process_begin_loop, so that interviews already recorded still replay.
+    static constexpr size_t loop_operand_max_size = 4096;
 
     the_stack_frame(const the_stack& ts, language_t lang, const question_begin_loop_r& qbl, const answer_r& loa):
       _question_begin_loop(qbl),
       _loop_operand_answer(loa),
+      _loop_operand_language(lang),
       _index(0) // Loop index starts at 0. Increases at each begin loop and decreases at each end loop.
     {
-      _loop_operand = calculate_loop_operand(ts, lang);
       HX2A_ASSERT(qbl->get_operand_question() == loa->get_question());
-      // Let's calculate the loop variable and operand size.
-      json::value v = get_loop_operand();
-
-      if (const json::array_type* arr = v.if_array()){
-	_loop_operand_size = arr->size();
-      }
-      else{
-	_loop_operand_size = 0;
-      }
+      set_loop_operand(calculate_loop_operand(ts, lang));
     }
+
+    // Restores a frame from its persisted image. Does not run V8.
+    the_stack_frame(const stack_snapshot_frame_r&);
+
+    stack_snapshot_frame_r make_snapshot() const;
     
     question_begin_loop_r get_question_begin_loop() const { return _question_begin_loop; }
     
@@ -2824,7 +3153,6 @@ namespace interviews {
     size_t get_index() const { return _index; }
 
     size_t increment_index(){
-      _loop_variable_value.reset();
       return ++_index;
     }
     
@@ -2832,68 +3160,98 @@ namespace interviews {
       return _question_begin_loop->get_variable();
     }
     
-    void replace_answer(const answer_r& a){
-      _answers_by_question_map[&a->get_question().get()] = a;
-    }
-    
-    answer_p find_answer(const question_r& q) const {
-      if (auto f = _answers_by_question_map.find(&q.get()); f != _answers_by_question_map.cend()){
-	return f->second;
+    // Returns true if an answer recorded in this frame already hid the answers to the question at the position given.
+    bool shadows(size_t position) const {
+      for (const auto& sa: _shadowed_answers){
+	if (sa._position == position){
+	  return true;
+	}
       }
-      
-      return {};
+
+      return false;
     }
+
+    void shadow(size_t position, const answer_p& hidden){
+      HX2A_ASSERT(!shadows(position));
+      _shadowed_answers.push_back({position, hidden});
+    }
+
+    shadowed_answers_type::const_iterator shadowed_answers_cbegin() const { return _shadowed_answers.cbegin(); }
+
+    shadowed_answers_type::const_iterator shadowed_answers_cend() const { return _shadowed_answers.cend(); }
     
     void dump() const {
       HX2A_LOG(trace) << "Question begin loop " << _question_begin_loop->get_label() << " operating on question operand " << _loop_operand_answer->get_question()->get_label();
       HX2A_LOG(trace) << "Index is " << _index;
-      
-      if (_answers_by_question_map.empty()){
-	HX2A_LOG(trace) << "No answers.";
-      }
-      else{
-	HX2A_LOG(trace) << "Answers:";
-	
-	for (const auto& p: _answers_by_question_map){
-	  HX2A_LOG(trace) << p.first->get_label();
-	}
-      }
+      HX2A_LOG(trace) << "Answers in the nest: " << _shadowed_answers.size();
     }
 
+    // The loop variable is the element of the loop operand at the current index, null if there is none. It is obtained
+    // natively, V8 only runs once per loop to calculate the operand.
     json::value get_loop_variable_value(const the_stack& ts, language_t lang) const {
-      if (_loop_variable_value){
-	return *_loop_variable_value;
+      if (_loop_operand_language != lang){
+	// Restored from a snapshot without its language, or calculated in another language. The operand uses localized
+	// answers. The iterations remain the ones decided when the loop started.
+	_loop_operand = calculate_loop_operand(ts, lang);
+	_loop_operand_language = lang;
       }
-      
-      json::value v = calculate_loop_variable_value(ts, lang, _question_begin_loop, _loop_operand_answer, _index);
-      _loop_variable_value = v;
-      return *_loop_variable_value;
+
+      if (const json::array_type* arr = _loop_operand.if_array(); arr && _index < arr->size()){
+	return (*arr)[_index];
+      }
+
+      return {};
     }
-    
-    static json::value calculate_loop_variable_value(const the_stack&, language_t, const question_begin_loop_r&, const answer_r& loop_operand_answer, size_t index);
 
     json::value calculate_loop_operand(const the_stack&, language_t) const;
     
   private:
 
+    // Sets the loop operand and calculates its size.
+    void set_loop_operand(json::value v){
+      _loop_operand = ::std::move(v);
+
+      if (const json::array_type* arr = _loop_operand.if_array()){
+	_loop_operand_size = arr->size();
+      }
+      else{
+	_loop_operand_size = 0;
+      }
+    }
+
     question_begin_loop_r _question_begin_loop;
     answer_r _loop_operand_answer;
-    json::value _loop_operand;
+    mutable json::value _loop_operand;
     size_t _loop_operand_size;
-    mutable std::optional<json::value> _loop_variable_value;
+    // Unknown for frames restored from a snapshot.
+    mutable ::std::optional<language_t> _loop_operand_language;
     size_t _index;
-    // All the answers in the loop nest per question pointer. There is guaranteed unicity. The map does not contain
-    // answers in higher nest levels, we're using all this one-off so there is no point optimizing much.
-    answers_by_question_map _answers_by_question_map;
+    // One per question answered in the loop nest, with the answer it hid.
+    shadowed_answers_type _shadowed_answers;
   };
 
-  // The stack contains a map of answers by question at every stack frame level to be able to pop frames easily when
-  // one or several question end loop are encountered.
+  // The stack indexes the visible answers by question position, which is the question ordinal when the ordinals of the
+  // questionnaire can be trusted. Questionnaires compiled before ordinals existed have all their ordinals at 0, the
+  // positions are then assigned by label as questions are met. Because of loops there might be several answers for the same
+  // question, only the last one is visible. Stack frames keep what they hid to be able to pop them easily when one or
+  // several question end loop are encountered.
+  // The stack is built for the duration of a request. It also memoizes the JSON values of the answers injected in
+  // JavaScript code (the "arguments"). Within a request the same answer is often an argument of several transitions,
+  // text functions and loop operands.
   class the_stack
   {
   public:
 
-    using answers_by_question_map = the_stack_frame::answers_by_question_map;
+    // Indexed by question position. Copying the stack is cheap.
+    using answers_type = ::std::vector<answer_p>;
+
+    // Tells whether the question ordinals can be trusted, which is the case if the questionnaire has an execution plan.
+    // The stack must be empty.
+    void set_by_ordinal(bool b){
+      HX2A_ASSERT(_answers.empty());
+      _by_ordinal = b;
+      _positions.clear();
+    }
 
     bool empty() const { return _vector.empty(); }
     
@@ -2909,6 +3267,11 @@ namespace interviews {
       return _vector.back().get_index();
     }
 
+    size_t get_loop_operand_size() const {
+      HX2A_ASSERT(_vector.size());
+      return _vector.back().get_loop_operand_size();
+    }
+
     void process_entry(language_t lang, const entry_r& e){
       switch (e->get_loop_type()){
       case question::regular:
@@ -2943,12 +3306,14 @@ namespace interviews {
     void process_begin_loop(language_t lang, const question_begin_loop_r& qbl, const answer_r& loa){
       if (_vector.empty()){
 	_vector.emplace_back(the_stack_frame(*this, lang, qbl, loa));
+	forget_localized_arguments();
       }
       else{
 	the_stack_frame& tsf = _vector.back();
 
 	if (tsf.get_question_begin_loop() != qbl){
 	  _vector.emplace_back(*this, lang, qbl, loa);
+	  forget_localized_arguments();
 	}
       }
     }
@@ -2962,25 +3327,38 @@ namespace interviews {
 	return {};
       }
 
-      json::value first = the_stack_frame::calculate_loop_variable_value(*this, lang, qbl, *loa, 0);
+      // Next iterations of the loop in progress, the operand is already known.
+      if (!_vector.empty() && _vector.back().get_question_begin_loop() == qbl){
+	return loa;
+      }
+
+      the_stack_frame tsf(*this, lang, qbl, *loa);
+      json::value first = tsf.get_loop_variable_value(*this, lang);
       HX2A_LOG(trace) << "The first value of the loop variable is " << first;
 
       if (!first){
 	return {};
       }
       
-      process_begin_loop(lang, qbl, *loa);
+      _vector.push_back(::std::move(tsf));
+      forget_localized_arguments();
       return loa;
     }
 
     // Returns true if no frame popping happened.
     bool process_end_loop(){
       HX2A_ASSERT(_vector.size());
+      // Either the loop variable changes or the frame is popped.
+      forget_localized_arguments();
       the_stack_frame& tsf = _vector.back();
 
       if (tsf.increment_index() == tsf.get_loop_operand_size()){
 	HX2A_LOG(trace) << "Popping the stack.";
-	// End of loop.
+	// End of loop. The answers hidden by the nest are visible again.
+	for (auto i = tsf.shadowed_answers_cbegin(), e = tsf.shadowed_answers_cend(); i != e; ++i){
+	  _answers[i->_position] = i->_answer;
+	}
+	
 	_vector.pop_back();
 	return false;
       }
@@ -3011,34 +3389,62 @@ namespace interviews {
     }
     
     void replace_answer(const answer_r& a){
-      if (_vector.empty()){
-	_answers_by_question_map[&a->get_question().get()] = a;
+      forget_localized_arguments();
+      size_t o = get_position(a->get_question());
+
+      if (o >= _answers.size()){
+	_answers.resize(o + 1);
       }
-      else{
-	_vector.back().replace_answer(a);
+      
+      if (!_vector.empty()){
+	the_stack_frame& tsf = _vector.back();
+
+	if (!tsf.shadows(o)){
+	  tsf.shadow(o, _answers[o]);
+	}
       }
+
+      _answers[o] = a;
+    }
+
+    // Returns the argument corresponding to the answer, calling the function given to calculate it if it is not memoized
+    // yet. The function must return a json::value.
+    // Non localized arguments only depend on the answer. Localized ones embed calculated texts, which depend on the
+    // stack. They are forgotten as soon as the stack changes.
+    template <typename Function>
+    const json::value& get_argument(const answer_r& a, bool localized, language_t lang, Function&& f) const {
+      argument_key k{&a.get(), localized, localized ? lang : language_t{}};
+
+      if (auto i = _arguments.find(k); i != _arguments.cend()){
+	return i->second;
+      }
+
+      // The function might memoize other arguments, so we cannot reserve the entry before calling it.
+      json::value v = f();
+      return _arguments.emplace(k, ::std::move(v)).first->second;
     }
     
+    // Persistence of the stack, see stack_snapshot. The history size is the number of entries the stack was calculated
+    // from.
+    stack_snapshot_r make_snapshot(size_t history_size) const;
+
+    // The stack must be empty.
+    void restore(const stack_snapshot_r&);
+    
     answer_p find_answer(const question_r& q) const {
-      // We search from the innermost nest.
-      auto i = _vector.crbegin();
-      auto e = _vector.crend();
-      
-      while (i != e){
-	if (answer_p a = i->find_answer(q)){
-	  return a;
-	}
-	
-	++i;
+      size_t o;
+
+      if (_by_ordinal){
+	o = q->get_ordinal();
       }
-      
-      auto f = _answers_by_question_map.find(&q.get());
-      
-      if (f != _answers_by_question_map.cend()){
-	return f->second;
+      else if (auto f = _positions.find(q->get_label()); f != _positions.cend()){
+	o = f->second;
       }
-      
-      return {};
+      else{
+	return {};
+      }
+
+      return o < _answers.size() ? _answers[o] : answer_p{};
     }
 
     answer_p find_loop_operand_answer(const question_begin_loop_r& qbl) const {
@@ -3056,16 +3462,35 @@ namespace interviews {
       
       return {};
     }
+
+    // Returns true if the answer is visible, hidden by a loop nest or the operand of a loop. In other words, if the
+    // answer has any influence on what is calculated from the stack.
+    bool holds(const answer_r& a) const {
+      if (answer_p f = find_answer(a->get_question()); f && *f == a){
+	return true;
+      }
+
+      for (const auto& tsf: _vector){
+	if (tsf.get_loop_operand_answer() == a){
+	  return true;
+	}
+
+	for (auto i = tsf.shadowed_answers_cbegin(), e = tsf.shadowed_answers_cend(); i != e; ++i){
+	  if (i->_answer && *i->_answer == a){
+	    return true;
+	  }
+	}
+      }
+
+      return false;
+    }
     
     void dump() const {
-      if (_answers_by_question_map.empty()){
-	HX2A_LOG(trace) << "No answers.";
-      }
-      else{
-	HX2A_LOG(trace) << "Top level answers:";
+      HX2A_LOG(trace) << "Visible answers:";
 	
-	for (const auto& p: _answers_by_question_map){
-	  HX2A_LOG(trace) << p.first->get_label();
+      for (const auto& a: _answers){
+	if (a){
+	  HX2A_LOG(trace) << (*a)->get_label();
 	}
       }
       
@@ -3083,11 +3508,56 @@ namespace interviews {
     }
     
   private:
+
+    struct argument_key
+    {
+      const answer* _answer;
+      bool _localized;
+      language_t _language;
+
+      bool operator==(const argument_key& k) const {
+	return _answer == k._answer && _localized == k._localized && _language == k._language;
+      }
+    };
+
+    struct argument_key_hash
+    {
+      size_t operator()(const argument_key& k) const {
+	return ::std::hash<const answer*>()(k._answer) ^ (::std::hash<size_t>()(static_cast<size_t>(k._language)) << 1) ^ k._localized;
+      }
+    };
+
+    // Assigns a position to the question if it has none yet.
+    size_t get_position(const question_r& q){
+      if (_by_ordinal){
+	return q->get_ordinal();
+      }
+
+      return _positions.try_emplace(q->get_label(), _positions.size()).first->second;
+    }
+
+    void forget_localized_arguments(){
+      auto i = _arguments.begin();
+
+      while (i != _arguments.end()){
+	if (i->first._localized){
+	  i = _arguments.erase(i);
+	}
+	else{
+	  ++i;
+	}
+      }
+    }
     
     // Innermost nest last.
     ::std::vector<the_stack_frame> _vector;
-    // The map of answers at the top, without a loop nest, per question pointer. There is guaranteed unicity.
-    answers_by_question_map _answers_by_question_map;
+    bool _by_ordinal = false;
+    // The positions assigned by label, when the ordinals cannot be trusted.
+    ::std::unordered_map<string, size_t> _positions;
+    // The visible answers, whatever their nest, per question position.
+    answers_type _answers;
+    // Memoized arguments. Node-based, so that references returned stay valid when other arguments are added.
+    mutable ::std::unordered_map<argument_key, json::value, argument_key_hash> _arguments;
   };
   
   // The process to start an interview is usually as follows:
@@ -3105,9 +3575,17 @@ namespace interviews {
   // Throughout the process, the interview moves from a state to another, from "initiated" (just created),
   // "started" (it'll stay in this state throughout all questions and answers), until there is no next question
   // and it is marked "complete".
+  // Versions:
+  // - 1.2 adds the stack snapshot ("ss"), the stack checkpoints ("sc"), the stash ("st") and the answers start IP
+  //   address flag ("ips"). Older documents decode with no snapshot, no checkpoint and an empty stash, so the stack is
+  //   replayed from the start of the history, and their answers return the IP address stored in them.
+  // - 1.3 adds the log ("lg"). Older documents decode with no log, their whole content is in the history.
+  // - 1.4 adds the statistics flag ("ct"), and the loop operand language to the stack snapshot frames ("l"). Older
+  //   documents decode as not counted, the statistics ignore them, and their frames calculate their loop operand again
+  //   the first time a loop variable is used.
   class interview: public root<>
   {
-    HX2A_ROOT(interview, type_tag<"i">, 1.1, root,
+    HX2A_ROOT(interview, type_tag<"i">, 1.4, root,
 	      ((_campaign, "c"),
 	       (_start_ip_address, "sip"),
 	       (_start_timestamp, "sts"),
@@ -3119,11 +3597,29 @@ namespace interviews {
 	       (_questionnaire_localization, "l10n"),
 	       (_history, "h"),
 	       (_state, "s"),
-	       (_next_question, "n")));
+	       (_next_question, "n"),
+	       (_stack_snapshot, "ss"),
+	       (_stack_checkpoints, "sc"),
+	       (_stash, "st"),
+	       (_log, "lg"),
+	       (_counted, "ct")));
     
   public:
 
     using history_type = own_list<entry>;
+    using stack_checkpoints_type = own_list<stack_snapshot>;
+    // Only holds answer entries.
+    using stash_type = own_list<entry>;
+
+    // A stack checkpoint is kept every that many history entries, so that revising an answer does not replay the
+    // history from the start.
+    static constexpr size_t stack_checkpoints_interval = 64;
+
+    // The maximum number of resected answers kept for subsequent revisions. Beyond, the oldest ones are dropped.
+    static constexpr size_t stash_max_size = 64;
+
+    // The maximum number of entries appended to the log before they are moved to the history, see interview_log.
+    static constexpr size_t log_max_size = 16;
 
     enum state_t {
 		  initiated = 0, // Interview just created and not started.
@@ -3146,10 +3642,22 @@ namespace interviews {
       _questionnaire_localization(*this),
       _history(*this),
       _state(*this, initiated),
-      _next_question(*this)
+      _next_question(*this),
+      _stack_snapshot(*this),
+      _stack_checkpoints(*this),
+      _stash(*this),
+      _log(*this),
+      _counted(*this, campaign->statistics_size() != 0)
     {
     }
 
+    // Preparing the interview for a known interviewee. The identifier is kept at start if none is supplied then.
+    interview(const campaign_r& campaign, const string& interviewee_id):
+      interview(campaign)
+    {
+      _interviewee_id = interviewee_id;
+    }
+
     const string& get_start_ip_address() const { return _start_ip_address; }
 
     time_t get_start_timestamp() const { return _start_timestamp; }
@@ -3191,13 +3699,11 @@ namespace interviews {
     
     bool is_completed() const { return _state == completed; }
 
-    void set_next_question(const question_r& q){
-      if (q->is_final()){
-	_state = completed;
-      }
-      
-      _next_question = q;
-    }
+    // True if the interview is counted in the campaign statistics, see statistics.hpp. The differences it makes must
+    // only be recorded if it is.
+    bool is_counted() const { return _counted; }
+
+    void set_next_question(const question_r& q);
 
     // Non-const, it might update the stack. It will also update the next question.
     question_r calculate_new_next_question(the_stack&);
@@ -3259,32 +3765,91 @@ namespace interviews {
 
     question_r run_transitions(const the_stack&, const question_r&) const;
 
+    // Same as the questionnaire localization's, using the execution plan when there is one.
+    progress_t get_progress(const question_r&) const;
+
     // Implicity applies to the next question.
     // Every time an answer is submitted a check is made that the campaign is still active.
+    // Appended to the log if it is open, see open_log.
     void add_answer(const answer_r& a){
-      _history.push_back(make<entry_answer>(a));
+      a->intern_ip_address(_start_ip_address);
+      add_entry(make<entry_answer>(a), true);
     }
 
     void add_begin_loop(const question_begin_loop_r& qbl, const answer_r& loop_answer, size_t index){
-      _history.push_back(make<entry_begin_loop>(qbl, loop_answer, index));
+      add_entry(make<entry_begin_loop>(qbl, loop_answer, index), false);
     }
 
     void add_end_loop(const question_end_loop_r& qel){
-      _history.push_back(make<entry_end_loop>(qel));
+      add_entry(make<entry_end_loop>(qel), false);
     }
 
+    // From now on, and for the duration of the request, entries are appended to the log rather than to the history,
+    // so that the interview document is not written again. Only moving ahead is supported on an interview with an open
+    // log. Moving ahead compacts the log when it is full or when the interview is completed.
+    void open_log();
+
+    // Moves the log entries, if any, to the history. Requests modifying the history must compact the interview first.
+    // Calculating the whole stack, the next question and the last answer take the log into account, and so do the read
+    // requests, which never compact.
+    void compact();
+
+    interview_log_p get_log() const { return _log; }
+
+    // Calls the function on the entries of the history followed by the ones of the log, as if the interview was
+    // compacted.
+    template <typename Function>
+    void for_each_entry(Function&&) const;
+
+    // The stack snapshots only cover a prefix of the history. Appending entries keeps them valid, inserting does not.
     void insert_answer(history_type::iterator pos, const answer_r& a){
+      forget_stack(::std::distance(_history.begin(), pos));
+      forget_history_index();
       _history.insert(pos, make<entry_answer>(a));
     }
 
+    // Persists the stack calculated for the whole history, so that next requests only replay the entries added later.
+    // Also keeps it as a checkpoint if the last one is far enough behind.
+    void save_stack(const the_stack& ts){
+      size_t hs = _history.size();
+      _stack_snapshot = ts.make_snapshot(hs);
+      size_t lhs = 0;
+
+      if (auto i = _stack_checkpoints.crbegin(); i != _stack_checkpoints.crend()){
+	HX2A_ASSERT(*i);
+	lhs = (*i)->get_history_size();
+      }
+
+      if (hs >= lhs + stack_checkpoints_interval){
+	_stack_checkpoints.push_back(ts.make_snapshot(hs));
+      }
+    }
+
+    // Must be called before any modification of the history other than appending entries. Drops the stack snapshots
+    // covering more entries than the first number given, and less than the second one. The snapshots covering at least
+    // the second number of entries are only kept when the caller knows that the stack is the same at that point.
+    void forget_stack(size_t from, size_t to = ::std::numeric_limits<size_t>::max());
+
+    // Returns the stack snapshot covering the largest number of entries not exceeding the number given, if any.
+    stack_snapshot_p find_stack_snapshot(size_t) const;
+
+    // Same for the history index.
+    void forget_history_index(){
+      _history_indexed = false;
+      _history_index.clear();
+      _log_index.clear();
+      _answers_positions.clear();
+    }
+
     // Just checks that there is really a regular answer at the index specified.
     history_type::iterator find_answer(size_t index){
-      if (index >= _history.size()){
+      index_history();
+      
+      if (index >= _history_index.size()){
 	throw answer_index_does_not_exist(index);
       }
 
-      history_type::iterator i = _history.begin();
-      ::std::advance(i, index);
+      history_type::iterator i = _history_index[index];
       HX2A_ASSERT(*i);
       
       if ((*i)->get_loop_type() != question::regular){
@@ -3294,91 +3859,58 @@ namespace interviews {
       return i;
     }
     
-    // Returns the iterator pointing at a "real" answer in the history (not a begin or end loop), with an
-    // index in the history equal or inferior to the index supplied.
-    // The index is updated to the actual value found.
-    history_type::iterator find_answer_at_most(size_t& index){
-      if (index >= _history.size()){
-	throw answer_index_does_not_exist(index);
-      }
-
-      auto i = _history.begin();
-      ::std::advance(i, index);
+    // The positions below are in the history followed by the log, as if the interview was compacted.
 
-      do {
-	if (!index){
-	  // The first entry is necessarily a real answer.
-	  HX2A_ASSERT((*i) && (*i)->get_loop_type() == question::regular);
-	  return i;
-	}
-
-	HX2A_ASSERT(*i);
-	entry_r e = **i;
+    // Returns the position of a "real" answer (not a begin or end loop), equal or inferior to the position supplied.
+    size_t find_answer_at_most(size_t position){
+      index_history();
+      
+      if (position >= entries_size()){
+	throw answer_index_does_not_exist(position);
+      }
 
-	if (e->get_loop_type() == question::regular){
-	  return i;
-	}
-	
-	--index;
-	--i;
-      } while (true);
+      auto f = ::std::upper_bound(_answers_positions.cbegin(), _answers_positions.cend(), position);
+      // The first entry is necessarily a real answer.
+      HX2A_ASSERT(f != _answers_positions.cbegin());
+      return *--f;
     }
 
     // Same but equal or superior.
-    history_type::iterator find_answer_at_least(size_t& index){
-      size_t hsz = _history.size();
-
-      // Although we test in the loop below, we cannot call advance illegitimately. So we have to check.
-      if (index >= hsz){
-	throw answer_index_does_not_exist(index);
+    size_t find_answer_at_least(size_t position){
+      index_history();
+      
+      if (position >= entries_size()){
+	throw answer_index_does_not_exist(position);
       }
 
-      auto i = _history.begin();
-      ::std::advance(i, index);
-      size_t idx = index;
+      auto f = ::std::lower_bound(_answers_positions.cbegin(), _answers_positions.cend(), position);
 
-      do {
-	if (index == hsz){
-	  throw answer_index_does_not_exist(idx);
-	}
-
-	HX2A_ASSERT(*i);
-	entry_r e = **i;
+      if (f == _answers_positions.cend()){
+	throw answer_index_does_not_exist(position);
+      }
 
-	if (e->get_loop_type() == question::regular){
-	  return i;
-	}
-	
-	++index;
-	++i;
-      } while (true);
+      return *f;
     }
 
-    // Returns the last answer in the interview.
-    answer_p last_answer() const {
-      if (!_history.size()){
-	return {};
-      }
-
-      auto i = _history.crbegin();
-      auto e = _history.crend();
+    // Returns the number of "real" answers.
+    size_t answers_size(){
+      index_history();
+      return _answers_positions.size();
+    }
 
-      while (i != e){
-	HX2A_ASSERT(*i);
-	entry_r e = **i;
+    // Returns the position of the nth "real" answer, from 0.
+    size_t get_answer_position(size_t n){
+      index_history();
 
-	if (e->get_loop_type() == question::regular){
-	  entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
-	  HX2A_ASSERT(ea);
-	  return ea->get_answer();
-	}
-	
-	++i;
+      if (n >= _answers_positions.size()){
+	throw answer_index_does_not_exist(n);
       }
 
-      HX2A_ASSERT(false);
-      return {};
+      return _answers_positions[n];
     }
+
+    // Returns the last answer in the interview, including the log entries.
+    answer_p last_answer() const;
     
     history_type::iterator find_answer(const string& question_label){
       return std::find_if(_history.begin(), _history.end(), [&](const entry_p& e){
@@ -3412,6 +3944,7 @@ namespace interviews {
     // Updates the state of the interview if needed.
     localized_question_p revise_answer(history_type::iterator pos, const answer_r& new_answer);
 
+    // Indices are positions in the history followed by the log, see for_each_entry. The interview is not compacted.
     // The argument gives the index following the answer needed. If the index is 0, the answer returned is the last one
     // recorded in the interview. This makes the transition from a question to a previous answer easier to implement in
     // the client side.
@@ -3429,16 +3962,16 @@ namespace interviews {
     // In case there is no answer yet, the timestamp of the start of the interview is used.
     pair<time_t, time_t> calculate_elapsed_times() const;
 
-    question_p get_next_question() const { return _next_question; }
+    // Takes the log into account.
+    question_p get_next_question() const;
 
     // Calculates the stack up to the iterator given in argument. The iterator has to be either the end or point at a
     // regular answer.
+    // Starts from the stack snapshot when it does not go past the iterator.
     void calculate(the_stack&, history_type::const_iterator) const;
 
-    // Calculates the stack for the whole history.
-    void calculate(the_stack& ts) const {
-      calculate(ts, _history.cend());
-    }
+    // Calculates the stack for the whole history, including the log entries.
+    void calculate(the_stack& ts) const;
     
   private:
 
@@ -3460,11 +3993,40 @@ namespace interviews {
 
     question_end_loop_p find_matching_end_loop(const question_begin_loop_r&) const;
 
+    // Builds the history index if necessary. It covers the log entries too.
+    void index_history();
+
+    // Keeps the history index up to date after an append to the history or to the log. If there is no index yet, no
+    // need to do anything.
+    void index_last_entry(bool is_answer);
+
+    // The number of entries in the history and in the log. The history must be indexed.
+    size_t entries_size() const {
+      HX2A_ASSERT(_history_indexed);
+      return _history_index.size() + _log_index.size();
+    }
+
+    // Calculates the stack for the entries preceding the position given, and returns the localized answer at that
+    // position. The history must be indexed.
+    localized_answer_data_and_more_payload_r make_answer_and_more(size_t position, bool more);
+
     // Used within the answer revision process. The new answer has been inserted, and it leads to another question,
     // different from the one in the entry the iterator points at. Resection will erase all subsequent history
     // up to the one that matches the question given in argument. The iterator to the corresponding entry is
     // returned. In case the question is not found, the history end iterator is returned.
-    void resect(history_type::iterator& pos, const question_r&);
+    // The answers erased are stashed, see stash. The ordinals of their questions are added to the set given. Returns
+    // false if begin or end loops were erased too.
+    bool resect(history_type::iterator& pos, const question_r&, const execution_plan*, question_set& resected);
+
+    // Called before erasing a history entry during a revision. If the entry is an answer which could be given again
+    // as is, the answer is moved to the stash, and the entry pointed at is left empty. The execution plan tells which
+    // answers can. Without a plan nothing is stashed.
+    void stash(history_type::iterator pos, const execution_plan*);
+
+    // Once a revision has set the next question, records the stashed answer to it, if any, instead of asking the
+    // question again, and moves ahead. Repeats as long as there are stashed answers to the next questions. Answers
+    // recorded again are timed as of now, so that the history remains chronological.
+    void regraft_stashed_answers(the_stack&, const execution_plan*);
     
     link<campaign> _campaign;
     slot<string> _start_ip_address;
@@ -3493,6 +4055,251 @@ namespace interviews {
     // to find the next question again. As transitions can be random, it would not be reliable.
     // A strong link would be more costly and unnecessary.
     weak_link<question> _next_question;
+    // The stack after the first entries of the history. Null until the first move ahead, and after a revision.
+    own<stack_snapshot> _stack_snapshot;
+    // Stacks after growing numbers of history entries, see stack_checkpoints_interval. Revisions and insertions drop
+    // the ones past the modified entry.
+    stack_checkpoints_type _stack_checkpoints;
+    // Answers resected by revisions, most recent last, at most one per question. They are recorded again if a later
+    // revision leads to their questions. They are moved along with their entries, so that they are never copied.
+    stash_type _stash;
+    // The entries appended since the last compaction, if any.
+    weak_link<interview_log> _log;
+    // True if the interview was created with the counters of its campaign.
+    slot<bool> _counted;
+    // Not persistent. True if the log is open.
+    bool _logging = false;
+    // Not persistent. Random access to the history entries then to the log entries, and positions of the "real" answers
+    // in both, in increasing order. Built on first use, maintained on appends and compactions, which do not change the
+    // positions, dropped on any other modification of the history.
+    bool _history_indexed = false;
+    ::std::vector<history_type::iterator> _history_index;
+    ::std::vector<history_type::const_iterator> _log_index;
+    ::std::vector<size_t> _answers_positions;
+  };
+
+  // The interview is a single document. Appending an answer to its history rewrites all the answers given so far. To
+  // avoid it, the answers are appended to a small separate document, the log, and moved to the interview history in
+  // batches. That way writing an answer costs in proportion to the log, not to the interview.
+  // There is at most one log per interview. It is reused after compactions.
+  class interview_log: public root<>
+  {
+    HX2A_ROOT(interview_log, type_tag<"i_log">, 1, root,
+	      ((_interview, "i"),
+	       (_entries, "e"),
+	       (_next_question, "n")));
+    
+  public:
+
+    using entries_type = own_list<entry>;
+
+    interview_log(const interview_r& i):
+      _interview(*this, i),
+      _entries(*this),
+      _next_question(*this)
+    {
+    }
+
+    entries_type::const_iterator entries_cbegin() const { return _entries.cbegin(); }
+
+    entries_type::const_iterator entries_cend() const { return _entries.cend(); }
+
+    entries_type::const_reverse_iterator entries_crbegin() const { return _entries.crbegin(); }
+
+    entries_type::const_reverse_iterator entries_crend() const { return _entries.crend(); }
+
+    size_t size() const { return _entries.size(); }
+
+    bool empty() const { return _entries.empty(); }
+
+    void push_entry_back(const entry_r& e){
+      _entries.push_back(e);
+    }
+
+    // Removes the first entry and returns it, for it to be adopted by the interview history. The log must not be empty.
+    entry_r pop_entry_front();
+
+    // Null if not set since the last compaction.
+    question_p get_next_question() const { return _next_question; }
+
+    void set_next_question(const question_p& q){
+      _next_question = q;
+    }
+
+  private:
+
+    // Strong, so that the log goes away with its interview.
+    link<interview> _interview;
+    entries_type _entries;
+    weak_link<question> _next_question;
+  };
+
+  template <typename Function>
+  void interview::for_each_entry(Function&& f) const {
+    for (auto i = _history.cbegin(), e = _history.cend(); i != e; ++i){
+      HX2A_ASSERT(*i);
+      f(**i);
+    }
+
+    if (_log){
+      interview_log_r l = *_log;
+
+      for (auto i = l->entries_cbegin(), e = l->entries_cend(); i != e; ++i){
+	HX2A_ASSERT(*i);
+	f(**i);
+      }
+    }
+  }
+
+  // Campaign statistics counters, see statistics.hpp. Counters are differences added over time, they can only be
+  // interpreted once summed over all the documents of a campaign.
+
+  class rank_statistics: public element<>
+  {
+    HX2A_ELEMENT(rank_statistics, type_tag<"rank_stats">, element,
+		 ((_position, "p"),
+		  (_count, "c")));
+  public:
+
+    rank_statistics(size_t position):
+      _position(*this, position),
+      _count(*this, 0)
+    {
+    }
+
+    size_t get_position() const { return _position; }
+
+    int64_t get_count() const { return _count; }
+
+    void add(int64_t n){ _count = _count.get() + n; }
+
+  private:
+
+    // Starting at 0.
+    slot<size_t> _position;
+    slot<int64_t> _count;
+  };
+
+  class option_statistics: public element<>
+  {
+    HX2A_ELEMENT(option_statistics, type_tag<"option_stats">, element,
+		 ((_index, "i"),
+		  (_count, "c"),
+		  (_ranks, "r")));
+  public:
+
+    using ranks_type = own_list<rank_statistics>;
+
+    option_statistics(size_t index):
+      _index(*this, index),
+      _count(*this, 0),
+      _ranks(*this)
+    {
+    }
+
+    size_t get_index() const { return _index; }
+
+    int64_t get_count() const { return _count; }
+
+    void add(int64_t n){ _count = _count.get() + n; }
+
+    ranks_type::const_iterator ranks_cbegin() const { return _ranks.cbegin(); }
+
+    ranks_type::const_iterator ranks_cend() const { return _ranks.cend(); }
+
+    // Returns the counter for the rank position, adding it if necessary.
+    rank_statistics_r get_rank(size_t position);
+
+  private:
+
+    slot<size_t> _index;
+    slot<int64_t> _count;
+    // Only for ranking questions.
+    ranks_type _ranks;
+  };
+
+  class question_statistics: public element<>
+  {
+    HX2A_ELEMENT(question_statistics, type_tag<"question_stats">, element,
+		 ((_label, "l"),
+		  (_answers, "a"),
+		  (_pending, "p"),
+		  (_options, "o")));
+  public:
+
+    using options_type = own_list<option_statistics>;
+
+    question_statistics(const string& label):
+      _label(*this, label),
+      _answers(*this, 0),
+      _pending(*this, 0),
+      _options(*this)
+    {
+    }
+
+    const string& get_label() const { return _label; }
+
+    int64_t get_answers() const { return _answers; }
+
+    int64_t get_pending() const { return _pending; }
+
+    void add(int64_t answers, int64_t pending){
+      _answers = _answers.get() + answers;
+      _pending = _pending.get() + pending;
+    }
+
+    options_type::const_iterator options_cbegin() const { return _options.cbegin(); }
+
+    options_type::const_iterator options_cend() const { return _options.cend(); }
+
+    // Returns the counter for the option, adding it if necessary.
+    option_statistics_r get_option(size_t index);
+
+  private:
+
+    slot<string> _label;
+    slot<int64_t> _answers;
+    // The number of interviews not completed whose next question is this one.
+    slot<int64_t> _pending;
+    options_type _options;
+  };
+
+  class campaign_statistics: public root<>
+  {
+    HX2A_ROOT(campaign_statistics, type_tag<"c_stats">, 1.0, root,
+	      ((_campaign, "c"),
+	       (_initiated, "si"),
+	       (_ongoing, "so"),
+	       (_completed, "sc"),
+	       (_questions, "q")));
+  public:
+
+    using questions_type = own_list<question_statistics>;
+
+    campaign_statistics(const campaign_r& c):
+      _campaign(*this, c),
+      _initiated(*this, 0),
+      _ongoing(*this, 0),
+      _completed(*this, 0),
+      _questions(*this)
+    {
+    }
+
+    // Adds the differences to the counters.
+    void add(const statistics_delta&);
+
+    // Adds the counters to the differences.
+    void sum_into(statistics_delta&) const;
+
+  private:
+
+    // Strong, so that the counters go away with their campaign.
+    link<campaign> _campaign;
+    slot<int64_t> _initiated;
+    slot<int64_t> _ongoing;
+    slot<int64_t> _completed;
+    // By label, in the order they were first counted.
+    questions_type _questions;
   };
 
   // Inlines.
@@ -0,0 +1,92 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#ifndef HX2A_INTERVIEWS_PARAMETRIC_TEXT_HPP
+#define HX2A_INTERVIEWS_PARAMETRIC_TEXT_HPP
+
+// Design notes:
+//
+// Question texts can contain calls to text functions, like @{0}, and loop variables, like @{country}. Texts are
+// rendered at every next question and twice per impacted entry when an answer is revised. Scanning them character by
+// character at every rendering is wasteful, as they never change once localized.
+//
+// Texts are therefore parsed once into a list of segments: literals, function calls and loop variables. Rendering
+// then merely concatenates. Parsed texts are immutable and shared, they are registered process-wide by text, and each
+// thread keeps the ones it used in front of the registry to look them up without locking. The same parser validates
+// texts at questionnaire compilation, so validation and rendering cannot disagree.
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "interviews/misc.hpp"
+
+namespace interviews {
+
+  using std::string;
+  using std::string_view;
+
+  class parametric_text
+  {
+  public:
+
+    struct segment
+    {
+      enum kind_t {
+		   literal,
+		   function_call,
+		   loop_variable
+      };
+
+      kind_t _kind;
+      // The literal text or the loop variable name.
+      string _value;
+      // The function index for function calls.
+      size_t _function;
+    };
+
+    using segments_type = ::std::vector<segment>;
+
+    // Never throws. Malformed calls are kept as literals.
+    static parametric_text parse(string_view);
+
+    // Returns true if the text does not contain any function call or loop variable, i.e., if it renders as is.
+    static bool is_literal(string_view text){
+      return text.find(eval_prefix) == string_view::npos;
+    }
+
+    const segments_type& get_segments() const { return _segments; }
+
+    // The total size of the literals, to reserve the rendered string.
+    size_t get_literals_size() const { return _literals_size; }
+
+    // Returns true if a function call refers to a function with an index equal or superior to the number given.
+    bool calls_function_beyond(size_t) const;
+
+  private:
+
+    parametric_text():
+      _literals_size(0)
+    {
+    }
+
+    void push_literal(string_view);
+
+    segments_type _segments;
+    size_t _literals_size;
+  };
+
+  class parametric_texts
+  {
+  public:
+
+    // Returns the parsed text, parsing it if necessary.
+    static ::std::shared_ptr<const parametric_text> get(const string&);
+  };
+
+} // End namespace interviews.
+
+#endif
@@ -45,6 +45,7 @@
 #include "hx2a/components/language.hpp"
 
 #include "interviews/ontology.hpp"
+#include "interviews/statistics.hpp"
 
 namespace interviews {
 
@@ -186,10 +187,30 @@ namespace interviews {
   class localized_interview_data;
   using localized_interview_data_p = ptr<localized_interview_data>;
 
+  class localized_interviews_data;
+  using localized_interviews_data_p = ptr<localized_interviews_data>;
+  using localized_interviews_data_r = rfr<localized_interviews_data>;
+
   class submit_answer_payload;
   using submit_answer_payload_p = ptr<submit_answer_payload>;
   using submit_answer_payload_r = rfr<submit_answer_payload>;
 
+  class export_cell;
+  using export_cell_p = ptr<export_cell>;
+  using export_cell_r = rfr<export_cell>;
+
+  class interview_ids;
+  using interview_ids_p = ptr<interview_ids>;
+  using interview_ids_r = rfr<interview_ids>;
+
+  class option_statistics_data;
+  using option_statistics_data_p = ptr<option_statistics_data>;
+  using option_statistics_data_r = rfr<option_statistics_data>;
+
+  class question_statistics_data;
+  using question_statistics_data_p = ptr<question_statistics_data>;
+  using question_statistics_data_r = rfr<question_statistics_data>;
+
   class source_option: public element<>
   {
     HX2A_ELEMENT(source_option, type_tag<"src_option">, element,
@@ -1875,6 +1896,56 @@ namespace interviews {
     slot<doc_id> _localization_id;
   };
 
+  // Tells which evaluation path a transition condition takes, to help tuning questionnaires.
+  class transition_report: public element<>
+  {
+    HX2A_ELEMENT(transition_report, type_tag<"transition_report">, element,
+		 ((_question, question_tag),
+		  (_destination, destination_tag),
+		  (_path, path_tag),
+		  (_native_runs, native_runs_tag),
+		  (_v8_runs, v8_runs_tag),
+		  (_slow_runs, slow_runs_tag)));
+  public:
+
+    // Paths.
+    static constexpr char unconditional[] = "unconditional";
+    static constexpr char native[] = "native";
+    static constexpr char v8[] = "v8";
+
+    transition_report(const string& question, const string& destination, const string& path, uint64_t native_runs, uint64_t v8_runs, uint64_t slow_runs):
+      _question(*this, question),
+      _destination(*this, destination),
+      _path(*this, path),
+      _native_runs(*this, native_runs),
+      _v8_runs(*this, v8_runs),
+      _slow_runs(*this, slow_runs)
+    {
+    }
+
+    slot<string> _question;
+    slot<string> _destination;
+    slot<string> _path;
+    // Runs since the process started. Native runs falling back on V8 are counted as V8 runs.
+    slot<uint64_t> _native_runs;
+    slot<uint64_t> _v8_runs;
+    // Runs close to the JavaScript time budget, see javascript_budget. A condition often close to it should be simplified
+    // before it starts failing interviews.
+    slot<uint64_t> _slow_runs;
+  };
+
+  class questionnaire_transitions_report: public element<>
+  {
+    HX2A_ELEMENT(questionnaire_transitions_report, type_tag<"questionnaire_transitions_report">, element,
+		 ((_transitions, transitions_tag)));
+  public:
+
+    // All the transitions of all the questions, in the questionnaire order.
+    questionnaire_transitions_report(const questionnaire_r&);
+
+    own_vector<transition_report> _transitions;
+  };
+
   // Differs from query_id only on the tag.
   class interview_id_payload: public element<>
   {
@@ -2171,7 +2242,7 @@ namespace interviews {
     {
     }
       
-    answer_data(const answer_r&, time_t start_timestamp);
+    answer_data(const answer_r&, time_t start_timestamp, const string& start_ip_address);
 
     // The label must be present, otherwise there is no way to figure out which question the answer is for.
     slot<string> _label;
@@ -2393,6 +2464,78 @@ namespace interviews {
     slot<interview::state_t> _state;
   };
 
+  // Campaign export, in columnar form. There is one column per question receiving answers, with its position in the
+  // questionnaire and the question label. Each interview is a row only carrying the columns answered, identified by
+  // label, with several answers per column in loops. Labels rather than ordinals, as questionnaires compiled before
+  // ordinals existed have them all at 0. Columns are obtained once per campaign, and rows are paginated over the campaign interviews, so that
+  // exporting large campaigns never builds the whole campaign at once.
+
+  class export_column: public element<>
+  {
+    HX2A_ELEMENT(export_column, type_tag<"export_column_pld">, element,
+		 ((_index, index_tag),
+		  (_label, label_tag)));
+  public:
+
+    export_column(size_t index, const string& label):
+      _index(*this, index),
+      _label(*this, label)
+    {
+    }
+
+    slot<size_t> _index;
+    slot<string> _label;
+  };
+
+  class export_columns: public element<>
+  {
+    HX2A_ELEMENT(export_columns, type_tag<"export_columns_pld">, element,
+		 ((_columns, columns_tag)));
+  public:
+
+    export_columns(const questionnaire_r&);
+
+    own_list<export_column> _columns;
+  };
+
+  class export_cell: public element<>
+  {
+    HX2A_ELEMENT(export_cell, type_tag<"export_cell_pld">, element,
+		 ((_label, label_tag),
+		  (_answers, answers_tag)));
+  public:
+
+    export_cell(const string& label):
+      _label(*this, label),
+      _answers(*this)
+    {
+    }
+
+    slot<string> _label;
+    // In the order they were given.
+    own_list<answer_data> _answers;
+  };
+
+  class export_row: public element<>
+  {
+    HX2A_ELEMENT(export_row, type_tag<"export_row_pld">, element,
+		 ((_interview_id, interview_id_tag),
+		  (_interviewee_id, interviewee_id_tag),
+		  (_start_timestamp, start_timestamp_tag),
+		  (_state, state_tag),
+		  (_cells, cells_tag)));
+  public:
+
+    export_row(const interview_r&);
+
+    slot<doc_id> _interview_id;
+    slot<string> _interviewee_id;
+    slot<time_t> _start_timestamp;
+    slot<interview::state_t> _state;
+    // In the order of the first answer to each column.
+    own_list<export_cell> _cells;
+  };
+
   // Same including localized data, e.g. for review after answering all the questionnaire.
   
   // We use inheritance as we're just adding localized texts/labels.
@@ -2653,6 +2796,15 @@ namespace interviews {
     // - If the language is not identical to the one the interview was made in.
     //   In that case, the cheaper interview data are calculated.
     localized_interview_data(const interview_r&, language_t);
+
+    // Same, with the localization map of the questionnaire in that language, see make_localization_map. Allows to
+    // share it across the interviews of a campaign.
+    localized_interview_data(const interview_r&, language_t, const questionnaire_localization_map_per_question&);
+
+    // Returns the question localizations to use to localize the interview in the language given, checking them. Empty
+    // if it is the language the interview was made in. The map only applies to interviews on the same questionnaire
+    // document.
+    static questionnaire_localization_map_per_question make_localization_map(const interview_r&, language_t);
     
     slot<string> _interviewee_id;
     slot<string> _interviewer_id;
@@ -2662,7 +2814,127 @@ namespace interviews {
     own_list<localized_answer_data> _answers;
     slot<interview::state_t> _state;
   };
+
+  // To localize several interviews at once.
+  class interview_ids_and_language_payload: public element<>
+  {
+    HX2A_ELEMENT(interview_ids_and_language_payload, type_tag<"interview_ids_and_lang_pld">, element,
+		 ((_interview_ids, interview_ids_tag),
+		  (_language, language_tag)));
+  public:
+
+    interview_ids_and_language_payload(serial_t):
+      element(serial),
+      _interview_ids(*this),
+      _language(*this, language::lang_eng) // Defaults to english.
+    {
+    }
+
+    slot_vector<doc_id> _interview_ids;
+    slot<language_t> _language;
+  };
+
+  class localized_interviews_data: public element<>
+  {
+    HX2A_ELEMENT(localized_interviews_data, type_tag<"l7d_interviews_data">, element,
+		 ((_interviews, interviews_tag)));
+  public:
+
+    localized_interviews_data():
+      _interviews(*this)
+    {
+    }
+
+    // In the order of the identifiers requested.
+    own_list<localized_interview_data> _interviews;
+  };
   
+  // Campaign statistics, see statistics.hpp.
+
+  class rank_statistics_data: public element<>
+  {
+    HX2A_ELEMENT(rank_statistics_data, type_tag<"rank_stats_pld">, element,
+		 ((_position, position_tag),
+		  (_count, count_tag)));
+  public:
+
+    rank_statistics_data(size_t position, int64_t count):
+      _position(*this, position),
+      _count(*this, count)
+    {
+    }
+
+    slot<size_t> _position;
+    slot<int64_t> _count;
+  };
+
+  class option_statistics_data: public element<>
+  {
+    HX2A_ELEMENT(option_statistics_data, type_tag<"option_stats_pld">, element,
+		 ((_index, index_tag),
+		  (_count, count_tag),
+		  (_ranks, ranks_tag)));
+  public:
+
+    option_statistics_data(size_t index, int64_t count):
+      _index(*this, index),
+      _count(*this, count),
+      _ranks(*this)
+    {
+    }
+
+    slot<size_t> _index;
+    slot<int64_t> _count;
+    // Only for ranking questions, by position.
+    own_list<rank_statistics_data> _ranks;
+  };
+
+  class question_statistics_data: public element<>
+  {
+    HX2A_ELEMENT(question_statistics_data, type_tag<"question_stats_pld">, element,
+		 ((_label, label_tag),
+		  (_answers, answers_count_tag),
+		  (_pending, pending_tag),
+		  (_options, options_tag)));
+  public:
+
+    question_statistics_data(const string& label, int64_t answers, int64_t pending):
+      _label(*this, label),
+      _answers(*this, answers),
+      _pending(*this, pending),
+      _options(*this)
+    {
+    }
+
+    slot<string> _label;
+    slot<int64_t> _answers;
+    // The number of interviews not completed standing at this question.
+    slot<int64_t> _pending;
+    // By index.
+    own_list<option_statistics_data> _options;
+  };
+
+  class campaign_statistics_data: public element<>
+  {
+    HX2A_ELEMENT(campaign_statistics_data, type_tag<"campaign_stats_pld">, element,
+		 ((_initiated, initiated_tag),
+		  (_ongoing, ongoing_tag),
+		  (_completed, completed_tag),
+		  (_completion_rate, completion_rate_tag),
+		  (_questions, questions_tag)));
+  public:
+
+    campaign_statistics_data(const statistics_delta&);
+
+    slot<int64_t> _initiated;
+    slot<int64_t> _ongoing;
+    slot<int64_t> _completed;
+    // Among the interviews started.
+    slot<percentage_t> _completion_rate;
+    // By label.
+    own_list<question_statistics_data> _questions;
+  };
+
   // Campaign payloads.
   
   class campaign_data: public element<>
@@ -2993,6 +3265,44 @@ namespace interviews {
   
   using interview_prepare_payload = campaign_id;
 
+  // Prepares a batch of interviews at once. Either a number of anonymous interviews, or one interview per interviewee
+  // identifier supplied, in which case the count is ignored.
+  class interview_prepare_bulk_payload: public element<>
+  {
+    HX2A_ELEMENT(interview_prepare_bulk_payload, type_tag<"interview_prepare_bulk_pld">, element,
+		 ((_campaign_id, campaign_id_tag),
+		  (_count, count_tag),
+		  (_interviewee_ids, interviewee_ids_tag)));
+  public:
+
+    interview_prepare_bulk_payload(serial_t):
+      element(serial),
+      _campaign_id(*this),
+      _count(*this),
+      _interviewee_ids(*this)
+    {
+    }
+
+    slot<doc_id> _campaign_id;
+    slot<size_t> _count;
+    slot_vector<string> _interviewee_ids;
+  };
+
+  // The identifiers of the interviews prepared, in the order of the interviewee identifiers if they were supplied.
+  class interview_ids: public element<>
+  {
+    HX2A_ELEMENT(interview_ids, type_tag<"interview_ids">, element,
+		 ((_interview_ids, interview_ids_tag)));
+  public:
+
+    interview_ids():
+      _interview_ids(*this)
+    {
+    }
+
+    slot_vector<doc_id> _interview_ids;
+  };
+
 } // End namespace interviews.
 
 #endif
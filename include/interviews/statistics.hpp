@@ -0,0 +1,109 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#ifndef HX2A_INTERVIEWS_STATISTICS_HPP
+#define HX2A_INTERVIEWS_STATISTICS_HPP
+
+// Design notes:
+//
+// Analysts follow campaigns while they run: how many interviews are started and completed, at which question the
+// interviews not completed stand, and how the answers distribute over the options and rank positions of each
+// question. Computing that from the interviews takes time proportional to their number.
+//
+// Instead, the services record the differences each change of an interview makes to the counters of its campaign.
+// Differences are accumulated in memory per campaign, and added to the counters documents once in a while, so that
+// answering does not write a shared document at every request. The counters of a campaign are spread over several
+// documents created with the campaign, each process adding to the one its identity designates, so that processes
+// seldom contend. Counters documents are written independently from the requests, a failure to write them never fails
+// a request. Reading the statistics sums these documents, in time proportional to the number of questions.
+//
+// Differences are added once they are old enough, whichever campaign the request recording new ones is about, so that
+// the campaigns going quiet are not left behind, and when the process exits.
+//
+// Counters are approximate. Differences accumulated by a process crashing before adding them are lost, as are the ones
+// recorded by a request failing afterwards. Campaigns and interviews created before the counters existed are not
+// counted.
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "interviews/ontology.hpp"
+
+namespace interviews {
+
+  class statistics_delta
+  {
+  public:
+
+    struct option_counts
+    {
+      int64_t _count = 0;
+      // Per rank position, starting at 0, for ranking questions only.
+      ::std::map<size_t, int64_t> _ranks;
+    };
+
+    struct question_counts
+    {
+      int64_t _answers = 0;
+      // The number of interviews not completed whose next question is this one.
+      int64_t _pending = 0;
+      // Per option index.
+      ::std::map<size_t, option_counts> _options;
+    };
+
+    // By question label rather than ordinal, so that counters remain meaningful if the campaign questionnaire is
+    // changed.
+    using questions_type = ::std::map<string, question_counts>;
+
+    // Counts the answer, or discounts it with a negative sign.
+    void add_answer(const answer&, int64_t sign);
+
+    // Counts the interview state and the question it stands at, and its answers too if requested.
+    void add_interview(const interview&, int64_t sign, bool with_answers = false);
+
+    void add_state(interview::state_t s, int64_t n){
+      HX2A_ASSERT(s <= interview::completed);
+      _states[s] += n;
+    }
+
+    void merge(const statistics_delta&);
+
+    int64_t get_state(interview::state_t s) const {
+      HX2A_ASSERT(s <= interview::completed);
+      return _states[s];
+    }
+
+    const questions_type& get_questions() const { return _questions; }
+
+    question_counts& get_question(const string& label){ return _questions[label]; }
+
+  private:
+
+    int64_t _states[interview::completed + 1] = {};
+    questions_type _questions;
+  };
+
+  class campaigns_statistics
+  {
+  public:
+
+    // Creates the counters documents of a new campaign.
+    static void prepare(const campaign_r&);
+
+    // Accumulates the differences for the campaign. Adds the differences accumulated long enough ago for any campaign
+    // to the counters documents.
+    static void record(const campaign_r&, const statistics_delta&);
+
+    // Adds the differences accumulated for the campaign by this process to the counters documents.
+    static void flush(const campaign_r&);
+
+    // The sum of the counters of the campaign, after flushing.
+    static statistics_delta read(const campaign_r&);
+  };
+
+} // End namespace interviews.
+
+#endif
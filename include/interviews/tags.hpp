@@ -25,15 +25,21 @@ namespace interviews {
   constexpr hx2a::service_name_t srv_tag = hx2a::srv_concat<"itv_", tag>;
 
   constexpr tag_t answer_tag                            = "answer";
+  constexpr tag_t answers_count_tag                     = "answers_count";
   constexpr tag_t answers_tag                           = "answers";
   constexpr tag_t body_tag                              = "body";
   constexpr tag_t campaign_id_tag                       = "campaign_id";
+  constexpr tag_t cells_tag                             = "cells";
   constexpr tag_t choice_tag                            = "choice";
   constexpr tag_t choices_tag                           = "choices";
   constexpr tag_t code_tag                              = "code";
+  constexpr tag_t columns_tag                           = "columns";
   constexpr tag_t comment_label_tag                     = "comment_label";
   constexpr tag_t comment_tag                           = "comment";
+  constexpr tag_t completed_tag                         = "completed";
+  constexpr tag_t completion_rate_tag                   = "completion_rate";
   constexpr tag_t condition_tag                         = "condition";
+  constexpr tag_t count_tag                             = "count";
   constexpr tag_t destination_tag                       = "destination";
   constexpr tag_t duration_tag                          = "duration";
   constexpr tag_t elapsed_tag                           = "elapsed";
@@ -42,12 +48,16 @@ namespace interviews {
   constexpr tag_t geolocation_tag                       = "geolocation";
   constexpr tag_t id_tag                                = "id";
   constexpr tag_t index_tag                             = "index";
+  constexpr tag_t initiated_tag                         = "initiated";
   constexpr tag_t input_tag                             = "input";
   constexpr tag_t interview_id_tag                      = "interview_id";
+  constexpr tag_t interview_ids_tag                     = "interview_ids";
   constexpr tag_t interview_lifespan_tag                = "interview_lifespan";
   constexpr tag_t interviewee_id_tag                    = "interviewee";
+  constexpr tag_t interviewee_ids_tag                   = "interviewees";
   constexpr tag_t interviewer_id_tag                    = "interviewer";
   constexpr tag_t interviewer_user_tag                  = "interviewer_user";
+  constexpr tag_t interviews_tag                        = "interviews";
   constexpr tag_t ip_address_tag                        = "ip_address";
   constexpr tag_t is_final_tag                          = "final";
   constexpr tag_t label_tag                             = "label";
@@ -58,17 +68,24 @@ namespace interviews {
   constexpr tag_t logo_tag                              = "logo";
   constexpr tag_t more_tag                              = "more";
   constexpr tag_t name_tag                              = "name";
+  constexpr tag_t native_runs_tag                       = "native_runs";
+  constexpr tag_t ongoing_tag                           = "ongoing";
   constexpr tag_t operand_tag                           = "operand";
   constexpr tag_t optional_tag                          = "optional";
   constexpr tag_t options_tag                           = "options";
   constexpr tag_t parameters_tag                        = "parameters";
   constexpr tag_t parent_tag                            = "parent";
+  constexpr tag_t path_tag                              = "path";
+  constexpr tag_t pending_tag                           = "pending";
+  constexpr tag_t position_tag                          = "position";
   constexpr tag_t progress_tag                          = "progress";
   constexpr tag_t question_tag                          = "question";
   constexpr tag_t questionnaire_id_tag                  = "questionnaire_id";
   constexpr tag_t questionnaire_localization_id_tag     = "questionnaire_localization_id";
   constexpr tag_t questions_tag                         = "questions";
   constexpr tag_t randomize_tag                         = "randomize";
+  constexpr tag_t ranks_tag                             = "ranks";
+  constexpr tag_t slow_runs_tag                         = "slow_runs";
   constexpr tag_t start_tag                             = "start";
   constexpr tag_t start_geolocation_tag                 = "start_geolocation";
   constexpr tag_t start_ip_address_tag                  = "start_ip_address";
@@ -84,6 +101,7 @@ namespace interviews {
   constexpr tag_t title_tag                             = "title";
   constexpr tag_t total_elapsed_tag                     = "total_elapsed";
   constexpr tag_t transitions_tag                       = "transitions";
+  constexpr tag_t v8_runs_tag                           = "v8_runs";
   constexpr tag_t value_tag                             = "value";
   constexpr tag_t variable_tag                          = "variable";
 
@@ -0,0 +1,1037 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+#include <utility>
+
+#include "interviews/conditions.hpp"
+#include "interviews/misc.hpp"
+
+namespace interviews {
+
+  using namespace hx2a;
+
+  using std::ostringstream;
+
+  struct expression::node
+  {
+    enum kind_t {
+		 literal,
+		 undefined,
+		 parameter,
+		 member,
+		 index,
+		 logical_not,
+		 negate,
+		 logical_and,
+		 logical_or,
+		 equal,
+		 not_equal,
+		 strict_equal,
+		 strict_not_equal,
+		 less,
+		 less_equal,
+		 greater,
+		 greater_equal
+    };
+
+    kind_t kind;
+    // For literals.
+    json::value value;
+    // For parameters.
+    size_t parameter = 0;
+    // For members.
+    string name;
+    // For unary operators, only the left operand is set.
+    ::std::shared_ptr<const node> left;
+    ::std::shared_ptr<const node> right;
+  };
+
+  namespace {
+
+    using node = expression::node;
+    using node_p = ::std::shared_ptr<const node>;
+
+    // Only ASCII is considered. Other strings have lengths and orderings which depend on their UTF-16 encoding.
+    bool is_ascii(const string& s){
+      for (unsigned char c: s){
+	if (c >= 0x80){
+	  return false;
+	}
+      }
+
+      return true;
+    }
+
+    // Names of the properties found on Object.prototype. A missing key with one of these names does not give
+    // undefined in JavaScript.
+    bool is_prototype_property(const string& name){
+      static constexpr const char* names[] = {
+	"__defineGetter__", "__defineSetter__", "__lookupGetter__", "__lookupSetter__", "__proto__",
+	"constructor", "hasOwnProperty", "isPrototypeOf", "propertyIsEnumerable", "toLocaleString",
+	"toString", "valueOf"
+      };
+
+      for (const char* n: names){
+	if (name == n){
+	  return true;
+	}
+      }
+
+      return false;
+    }
+
+    class tokenizer
+    {
+    public:
+
+      enum kind_t {end, identifier, number, string_literal, punctuator, error};
+
+      tokenizer(string_view code):
+	_i(code.cbegin()),
+	_e(code.cend())
+      {
+	next();
+      }
+
+      kind_t get_kind() const { return _kind; }
+
+      const string& get_text() const { return _text; }
+
+      double get_number() const { return _number; }
+
+      bool is(const char* p) const { return _kind == punctuator && _text == p; }
+
+      void next(){
+	_text.clear();
+
+	while (_i != _e && isspace(static_cast<unsigned char>(*_i))){
+	  ++_i;
+	}
+
+	if (_i == _e){
+	  _kind = end;
+	  return;
+	}
+
+	char c = *_i;
+
+	if (isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '$'){
+	  while (_i != _e && (isalnum(static_cast<unsigned char>(*_i)) || *_i == '_' || *_i == '$')){
+	    _text += *_i++;
+	  }
+
+	  _kind = identifier;
+	  return;
+	}
+
+	if (isdigit(static_cast<unsigned char>(c))){
+	  // Decimal numbers only. Octal, hexadecimal and the like are left to V8.
+	  while (_i != _e && (isdigit(static_cast<unsigned char>(*_i)) || *_i == '.')){
+	    _text += *_i++;
+	  }
+
+	  if (_i != _e && (isalpha(static_cast<unsigned char>(*_i)) || *_i == '_' || *_i == '$')){
+	    _kind = error;
+	    return;
+	  }
+
+	  size_t pos = 0;
+
+	  try {
+	    _number = ::std::stod(_text, &pos);
+	  }
+	  catch(...){
+	    _kind = error;
+	    return;
+	  }
+
+	  _kind = pos == _text.size() && (_text.size() == 1 || _text[0] != '0' || _text[1] == '.') ? number : error;
+	  return;
+	}
+
+	if (c == '"' || c == '\''){
+	  ++_i;
+
+	  while (_i != _e && *_i != c){
+	    if (*_i == '\\'){
+	      ++_i;
+
+	      if (_i == _e){
+		break;
+	      }
+
+	      switch (*_i){
+	      case '\\': _text += '\\'; break;
+	      case '\'': _text += '\''; break;
+	      case '"': _text += '"'; break;
+	      case 'n': _text += '\n'; break;
+	      case 't': _text += '\t'; break;
+	      default:
+		// Other escapes are left to V8.
+		_kind = error;
+		return;
+	      }
+
+	      ++_i;
+	      continue;
+	    }
+
+	    if (*_i == '\n'){
+	      break;
+	    }
+
+	    _text += *_i++;
+	  }
+
+	  if (_i == _e || *_i != c){
+	    _kind = error;
+	    return;
+	  }
+
+	  ++_i;
+	  _kind = string_literal;
+	  return;
+	}
+
+	// Longest punctuators first.
+	static constexpr const char* punctuators[] = {
+	  "===", "!==", "==", "!=", "<=", ">=", "&&", "||", "<", ">", "!", "-", "(", ")", "[", "]", ".", ";"
+	};
+
+	for (const char* p: punctuators){
+	  string_view pv(p);
+
+	  if (static_cast<size_t>(_e - _i) >= pv.size() && string_view(&*_i, pv.size()) == pv){
+	    _text = p;
+	    _i += pv.size();
+	    _kind = punctuator;
+	    return;
+	  }
+	}
+
+	_kind = error;
+      }
+
+    private:
+
+      string_view::const_iterator _i;
+      string_view::const_iterator _e;
+      kind_t _kind = end;
+      string _text;
+      double _number = 0;
+    };
+
+    // Recursive descent parser. Returns null pointers when the code is outside of the subset.
+    // Grammar:
+    // or         := and ('||' and)*
+    // and        := equality ('&&' equality)*
+    // equality   := relational (('==' | '!=' | '===' | '!==') relational)*
+    // relational := unary (('<' | '<=' | '>' | '>=') unary)*
+    // unary      := ('!' | '-') unary | postfix
+    // postfix    := primary ('.' identifier | '[' or ']')*
+    // primary    := number | string | true | false | null | undefined | parameter | '(' or ')'
+    class parser
+    {
+    public:
+
+      parser(string_view code, const ::std::vector<string>& parameters):
+	_t(code),
+	_parameters(parameters)
+      {
+      }
+
+      node_p parse(){
+	node_p n = parse_or();
+
+	if (!n){
+	  return {};
+	}
+
+	// Tolerating a single trailing semicolon.
+	if (_t.is(";")){
+	  _t.next();
+	}
+
+	if (_t.get_kind() != tokenizer::end){
+	  return {};
+	}
+
+	return n;
+      }
+
+    private:
+
+      static node_p make_binary(node::kind_t k, node_p l, node_p r){
+	if (!l || !r){
+	  return {};
+	}
+
+	auto n = ::std::make_shared<node>();
+	n->kind = k;
+	n->left = ::std::move(l);
+	n->right = ::std::move(r);
+	return n;
+      }
+
+      node_p parse_or(){
+	node_p l = parse_and();
+
+	while (l && _t.is("||")){
+	  _t.next();
+	  l = make_binary(node::logical_or, l, parse_and());
+	}
+
+	return l;
+      }
+
+      node_p parse_and(){
+	node_p l = parse_equality();
+
+	while (l && _t.is("&&")){
+	  _t.next();
+	  l = make_binary(node::logical_and, l, parse_equality());
+	}
+
+	return l;
+      }
+
+      node_p parse_equality(){
+	node_p l = parse_relational();
+
+	while (l){
+	  node::kind_t k;
+
+	  if (_t.is("===")){
+	    k = node::strict_equal;
+	  }
+	  else if (_t.is("!==")){
+	    k = node::strict_not_equal;
+	  }
+	  else if (_t.is("==")){
+	    k = node::equal;
+	  }
+	  else if (_t.is("!=")){
+	    k = node::not_equal;
+	  }
+	  else{
+	    break;
+	  }
+
+	  _t.next();
+	  l = make_binary(k, l, parse_relational());
+	}
+
+	return l;
+      }
+
+      node_p parse_relational(){
+	node_p l = parse_unary();
+
+	while (l){
+	  node::kind_t k;
+
+	  if (_t.is("<")){
+	    k = node::less;
+	  }
+	  else if (_t.is("<=")){
+	    k = node::less_equal;
+	  }
+	  else if (_t.is(">")){
+	    k = node::greater;
+	  }
+	  else if (_t.is(">=")){
+	    k = node::greater_equal;
+	  }
+	  else{
+	    break;
+	  }
+
+	  _t.next();
+	  l = make_binary(k, l, parse_unary());
+	}
+
+	return l;
+      }
+
+      node_p parse_unary(){
+	if (_t.is("!") || _t.is("-")){
+	  node::kind_t k = _t.is("!") ? node::logical_not : node::negate;
+	  _t.next();
+	  node_p o = parse_unary();
+
+	  if (!o){
+	    return {};
+	  }
+
+	  auto n = ::std::make_shared<node>();
+	  n->kind = k;
+	  n->left = ::std::move(o);
+	  return n;
+	}
+
+	return parse_postfix();
+      }
+
+      node_p parse_postfix(){
+	node_p l = parse_primary();
+
+	while (l){
+	  if (_t.is(".")){
+	    _t.next();
+
+	    if (_t.get_kind() != tokenizer::identifier){
+	      return {};
+	    }
+
+	    auto n = ::std::make_shared<node>();
+	    n->kind = node::member;
+	    n->name = _t.get_text();
+	    n->left = ::std::move(l);
+	    l = ::std::move(n);
+	    _t.next();
+	  }
+	  else if (_t.is("[")){
+	    _t.next();
+	    node_p i = parse_or();
+
+	    if (!i || !_t.is("]")){
+	      return {};
+	    }
+
+	    _t.next();
+	    l = make_binary(node::index, l, i);
+	  }
+	  else{
+	    break;
+	  }
+	}
+
+	return l;
+      }
+
+      node_p parse_primary(){
+	auto n = ::std::make_shared<node>();
+
+	switch (_t.get_kind()){
+	case tokenizer::number:
+	  {
+	    n->kind = node::literal;
+	    n->value = json::value(_t.get_number());
+	    _t.next();
+	    return n;
+	  }
+
+	case tokenizer::string_literal:
+	  {
+	    n->kind = node::literal;
+	    n->value = json::value(_t.get_text());
+	    _t.next();
+	    return n;
+	  }
+
+	case tokenizer::identifier:
+	  {
+	    const string& id = _t.get_text();
+
+	    if (id == "true" || id == "false"){
+	      n->kind = node::literal;
+	      n->value = json::value(id == "true");
+	    }
+	    else if (id == "null"){
+	      n->kind = node::literal;
+	    }
+	    else if (id == "undefined"){
+	      n->kind = node::undefined;
+	    }
+	    else{
+	      auto f = ::std::find(_parameters.cbegin(), _parameters.cend(), id);
+
+	      // Anything else (globals, library functions, keywords) is left to V8.
+	      if (f == _parameters.cend()){
+		return {};
+	      }
+
+	      n->kind = node::parameter;
+	      n->parameter = f - _parameters.cbegin();
+	    }
+
+	    _t.next();
+	    return n;
+	  }
+
+	case tokenizer::punctuator:
+	  {
+	    if (!_t.is("(")){
+	      return {};
+	    }
+
+	    _t.next();
+	    node_p i = parse_or();
+
+	    if (!i || !_t.is(")")){
+	      return {};
+	    }
+
+	    _t.next();
+	    return i;
+	  }
+
+	default:
+	  return {};
+	}
+      }
+
+      tokenizer _t;
+      const ::std::vector<string>& _parameters;
+    };
+
+    // A JavaScript value during native evaluation. It points into the arguments or into the expression tree, which
+    // both outlive the evaluation.
+    struct js_value
+    {
+      enum kind_t {undefined, null, boolean, number, string, object, array};
+
+      kind_t kind = undefined;
+      bool b = false;
+      double n = 0;
+      const ::std::string* s = nullptr;
+      // For objects and arrays. Strict equality on them is identity.
+      const json::value* j = nullptr;
+
+      static js_value from_json(const json::value& v){
+	js_value r;
+
+	if (v.if_object()){
+	  r.kind = object;
+	  r.j = &v;
+	}
+	else if (v.if_array()){
+	  r.kind = array;
+	  r.j = &v;
+	}
+	else if (const ::std::string* s = v.if_string()){
+	  r.kind = string;
+	  r.s = s;
+	}
+	else if (const bool* b = v.if_bool()){
+	  r.kind = boolean;
+	  r.b = *b;
+	}
+	else if (const double* d = v.if_double()){
+	  r.kind = number;
+	  r.n = *d;
+	}
+	else{
+	  r.kind = null;
+	}
+
+	return r;
+      }
+
+      static js_value from_number(double d){
+	js_value r;
+	r.kind = number;
+	r.n = d;
+	return r;
+      }
+
+      static js_value from_boolean(bool b){
+	js_value r;
+	r.kind = boolean;
+	r.b = b;
+	return r;
+      }
+
+      bool is_nullish() const { return kind == undefined || kind == null; }
+
+      bool truthy() const {
+	switch (kind){
+	case undefined:
+	case null:
+	  return false;
+	case boolean:
+	  return b;
+	case number:
+	  return n != 0 && !::std::isnan(n);
+	case string:
+	  return !s->empty();
+	default:
+	  return true;
+	}
+      }
+    };
+
+    using js_result = ::std::optional<js_value>;
+
+    ::std::optional<bool> strict_equals(const js_value& l, const js_value& r){
+      if (l.kind != r.kind){
+	return false;
+      }
+
+      switch (l.kind){
+      case js_value::undefined:
+      case js_value::null:
+	return true;
+      case js_value::boolean:
+	return l.b == r.b;
+      case js_value::number:
+	return l.n == r.n;
+      case js_value::string:
+	return *l.s == *r.s;
+      default:
+	return l.j == r.j;
+      }
+    }
+
+    ::std::optional<bool> loose_equals(const js_value& l, const js_value& r){
+      if (l.kind == r.kind){
+	return strict_equals(l, r);
+      }
+
+      // null and undefined are only loosely equal to each other.
+      if (l.is_nullish() || r.is_nullish()){
+	return l.is_nullish() && r.is_nullish();
+      }
+
+      // Coercion.
+      return {};
+    }
+
+    ::std::optional<bool> compare(node::kind_t k, const js_value& l, const js_value& r){
+      int c;
+
+      if (l.kind == js_value::number && r.kind == js_value::number){
+	if (::std::isnan(l.n) || ::std::isnan(r.n)){
+	  return false;
+	}
+
+	c = l.n < r.n ? -1 : (l.n > r.n ? 1 : 0);
+      }
+      else if (l.kind == js_value::string && r.kind == js_value::string && is_ascii(*l.s) && is_ascii(*r.s)){
+	c = l.s->compare(*r.s);
+      }
+      else{
+	// Coercion.
+	return {};
+      }
+
+      switch (k){
+      case node::less: return c < 0;
+      case node::less_equal: return c <= 0;
+      case node::greater: return c > 0;
+      default: return c >= 0;
+      }
+    }
+
+    js_result evaluate_node(const node& n, const expression::arguments& args){
+      switch (n.kind){
+      case node::literal:
+	return js_value::from_json(n.value);
+
+      case node::undefined:
+	return js_value();
+
+      case node::parameter:
+	return js_value::from_json(args[n.parameter]);
+
+      case node::member:
+	{
+	  js_result o = evaluate_node(*n.left, args);
+
+	  if (!o){
+	    return {};
+	  }
+
+	  switch (o->kind){
+	  case js_value::object:
+	    {
+	      // Arguments reach V8 as object literals, where __proto__ sets the prototype instead of adding a member.
+	      if (n.name == "__proto__"){
+		return {};
+	      }
+
+	      const json::object_type& obj = *o->j->if_object();
+	      auto f = obj.find(n.name);
+
+	      if (f != obj.cend()){
+		return js_value::from_json(f->second);
+	      }
+
+	      if (is_prototype_property(n.name)){
+		return {};
+	      }
+
+	      return js_value();
+	    }
+
+	  case js_value::array:
+	    {
+	      if (n.name == "length"){
+		return js_value::from_number(o->j->if_array()->size());
+	      }
+
+	      // Array methods.
+	      return {};
+	    }
+
+	  case js_value::string:
+	    {
+	      if (n.name == "length" && is_ascii(*o->s)){
+		return js_value::from_number(o->s->size());
+	      }
+
+	      return {};
+	    }
+
+	  default:
+	    // A TypeError on null and undefined, prototype properties otherwise.
+	    return {};
+	  }
+	}
+
+      case node::index:
+	{
+	  js_result o = evaluate_node(*n.left, args);
+
+	  if (!o || o->kind != js_value::array){
+	    return {};
+	  }
+
+	  js_result i = evaluate_node(*n.right, args);
+
+	  if (!i || i->kind != js_value::number || i->n < 0 || ::std::floor(i->n) != i->n){
+	    return {};
+	  }
+
+	  const json::array_type& arr = *o->j->if_array();
+
+	  if (i->n >= arr.size()){
+	    return js_value();
+	  }
+
+	  return js_value::from_json(arr[static_cast<size_t>(i->n)]);
+	}
+
+      case node::logical_not:
+	{
+	  js_result o = evaluate_node(*n.left, args);
+
+	  if (!o){
+	    return {};
+	  }
+
+	  return js_value::from_boolean(!o->truthy());
+	}
+
+      case node::negate:
+	{
+	  js_result o = evaluate_node(*n.left, args);
+
+	  if (!o || o->kind != js_value::number){
+	    return {};
+	  }
+
+	  return js_value::from_number(-o->n);
+	}
+
+      case node::logical_and:
+      case node::logical_or:
+	{
+	  js_result l = evaluate_node(*n.left, args);
+
+	  if (!l){
+	    return {};
+	  }
+
+	  // Short-circuiting, like JavaScript. The value of the operand is returned, not a boolean.
+	  if (l->truthy() == (n.kind == node::logical_or)){
+	    return l;
+	  }
+
+	  return evaluate_node(*n.right, args);
+	}
+
+      default:
+	{
+	  js_result l = evaluate_node(*n.left, args);
+
+	  if (!l){
+	    return {};
+	  }
+
+	  js_result r = evaluate_node(*n.right, args);
+
+	  if (!r){
+	    return {};
+	  }
+
+	  ::std::optional<bool> b;
+
+	  switch (n.kind){
+	  case node::equal:
+	    b = loose_equals(*l, *r);
+	    break;
+	  case node::not_equal:
+	    b = loose_equals(*l, *r);
+
+	    if (b){
+	      b = !*b;
+	    }
+
+	    break;
+	  case node::strict_equal:
+	    b = strict_equals(*l, *r);
+	    break;
+	  case node::strict_not_equal:
+	    b = !*strict_equals(*l, *r);
+	    break;
+	  default:
+	    b = compare(n.kind, *l, *r);
+	    break;
+	  }
+
+	  if (!b){
+	    return {};
+	  }
+
+	  return js_value::from_boolean(*b);
+	}
+      }
+    }
+
+  } // End anonymous namespace.
+
+  ::std::optional<expression> expression::compile(string_view code, const ::std::vector<string>& parameters){
+    parser p(code, parameters);
+
+    if (node_p n = p.parse()){
+      return expression(::std::move(n));
+    }
+
+    return {};
+  }
+
+  ::std::optional<bool> expression::evaluate(const arguments& args) const {
+    HX2A_ASSERT(_root);
+    js_result r = evaluate_node(*_root, args);
+
+    if (!r){
+      return {};
+    }
+
+    // Mimicking json::is_true on what V8 would have returned.
+    switch (r->kind){
+    case js_value::undefined:
+      // V8 does not return undefined as a JSON value, let it report it.
+      return {};
+    case js_value::boolean:
+      return r->b;
+    case js_value::number:
+      if (::std::isnan(r->n)){
+	return {};
+      }
+
+      return r->n != 0;
+    default:
+      return false;
+    }
+  }
+
+  namespace {
+
+    ::std::mutex compiled_conditions_mutex;
+    ::std::unordered_map<string, ::std::unique_ptr<compiled_condition>> compiled_conditions_map;
+    ::std::atomic<uint64_t> compiled_conditions_counter{0};
+
+    // Returns the name and the definition of the function, which is defined in the heap of the calling thread.
+    ::std::pair<string, string> compile_v8_function(const string& code, const ::std::vector<string>& parameters){
+      ostringstream on;
+      on << "itvCond" << ++compiled_conditions_counter;
+      string name(on.str());
+      ostringstream sig;
+      sig << "globalThis." << name << "=function(";
+      bool first = true;
+
+      for (const string& p: parameters){
+	if (!first){
+	  sig << ',';
+	}
+
+	sig << p;
+	first = false;
+      }
+
+      sig << "){return ";
+
+      // Most conditions are mere expressions. The newlines protect against trailing line comments.
+      // We return true to make sure the result is a parsable JSON value.
+      try {
+	ostringstream oc;
+	oc << sig.str() << "(\n" << code << "\n);};true";
+	v8_execute(oc.str());
+	return {name, oc.str()};
+      }
+      catch(...){
+	HX2A_LOG(trace) << "Condition is not an expression, compiling it as code.";
+      }
+
+      // Otherwise it contains statements, we must rely on eval to obtain the completion value. V8 keeps a cache of
+      // compiled eval code, so it is still a lot cheaper than recompiling the whole condition with its arguments.
+      ostringstream oc;
+      oc << sig.str() << "eval(" << json::value(code) << ");};true";
+      v8_execute(oc.str());
+      return {name, oc.str()};
+    }
+
+    // Returns the name and the definition of the function calling the conditions.
+    ::std::pair<string, string> compile_v8_route(const ::std::vector<compiled_conditions::route_condition>& conditions){
+      ostringstream on;
+      on << "itvRoute" << ++compiled_conditions_counter;
+      string name(on.str());
+      size_t arity = 0;
+
+      for (const auto& rc: conditions){
+	for (size_t a: rc._arguments){
+	  arity = ::std::max(arity, a + 1);
+	}
+      }
+
+      // The arguments are named after their positions, the question labels might collide with the function names.
+      ostringstream oc;
+      oc << "globalThis." << name << "=function(f,l";
+
+      for (size_t a = 0; a != arity; ++a){
+	oc << ",a" << a;
+      }
+
+      oc << "){let r;";
+
+      for (const auto& rc: conditions){
+	HX2A_ASSERT(rc._condition);
+	size_t p = rc._position;
+	oc << "if(f<=" << p << "&&" << p << "<l){r=" << rc._condition->get_function_name() << '(';
+	bool first = true;
+
+	for (size_t a: rc._arguments){
+	  if (!first){
+	    oc << ',';
+	  }
+
+	  oc << 'a' << a;
+	  first = false;
+	}
+
+	// Mimicking json::is_true on what the condition would have returned if run alone. Undefined is returned as is, so
+	// that it is reported the same way.
+	oc << ");if(r===undefined)return r;if(r===true||(typeof r==\"number\"&&r!==0&&isFinite(r)))return " << p << ";}";
+      }
+
+      oc << "return -1;};true";
+      return {name, oc.str()};
+    }
+
+    ::std::unordered_map<string, ::std::unique_ptr<compiled_route>> compiled_routes_map;
+
+    // The conditions and routes whose functions are defined in the heap of the thread. Neither is ever removed from the
+    // registry, so their addresses are stable.
+    thread_local ::std::unordered_set<const compiled_condition*> defined_conditions;
+    thread_local ::std::unordered_set<const compiled_route*> defined_routes;
+
+    // The conditions and routes the thread already looked up, in front of the registry, so that running transitions
+    // takes no lock. Stable addresses too.
+    thread_local ::std::unordered_map<string, const compiled_condition*> thread_compiled_conditions;
+    thread_local ::std::unordered_map<string, const compiled_route*> thread_compiled_routes;
+
+  } // End anonymous namespace.
+
+  void compiled_condition::define() const {
+    if (defined_conditions.insert(this).second){
+      v8_execute(_definition);
+    }
+  }
+
+  void compiled_route::define() const {
+    if (defined_routes.insert(this).second){
+      for (const compiled_condition* cc: _conditions){
+	cc->define();
+      }
+
+      v8_execute(_definition);
+    }
+  }
+
+  const compiled_condition& compiled_conditions::get(const string& key, const string& code, const ::std::vector<string>& parameters){
+    if (const compiled_condition* cc = find(key)){
+      return *cc;
+    }
+
+    // Compiling outside the lock. In the unlikely case two threads compile the same condition, they'll produce
+    // two identical functions, and only the first registered will be used.
+    auto [name, definition] = compile_v8_function(code, parameters);
+    auto cc = ::std::make_unique<compiled_condition>(::std::move(name), ::std::move(definition), expression::compile(code, parameters));
+    ::std::lock_guard<::std::mutex> l(compiled_conditions_mutex);
+    auto [f, inserted] = compiled_conditions_map.emplace(key, ::std::move(cc));
+
+    // Compiling defined the function in the heap of this thread. If another thread registered the condition first,
+    // its function is not defined here yet.
+    if (inserted){
+      defined_conditions.insert(f->second.get());
+    }
+
+    thread_compiled_conditions.emplace(key, f->second.get());
+    return *f->second;
+  }
+
+  const compiled_condition* compiled_conditions::find(const string& key){
+    if (auto f = thread_compiled_conditions.find(key); f != thread_compiled_conditions.cend()){
+      return f->second;
+    }
+    
+    ::std::lock_guard<::std::mutex> l(compiled_conditions_mutex);
+
+    if (auto f = compiled_conditions_map.find(key); f != compiled_conditions_map.cend()){
+      thread_compiled_conditions.emplace(key, f->second.get());
+      return f->second.get();
+    }
+
+    return nullptr;
+  }
+
+  const compiled_route& compiled_conditions::get_route(const string& key, const ::std::vector<route_condition>& conditions){
+    if (auto f = thread_compiled_routes.find(key); f != thread_compiled_routes.cend()){
+      return *f->second;
+    }
+    
+    {
+      ::std::lock_guard<::std::mutex> l(compiled_conditions_mutex);
+
+      if (auto f = compiled_routes_map.find(key); f != compiled_routes_map.cend()){
+	thread_compiled_routes.emplace(key, f->second.get());
+	return *f->second;
+      }
+    }
+
+    auto [name, definition] = compile_v8_route(conditions);
+    ::std::vector<const compiled_condition*> ccs;
+    ccs.reserve(conditions.size());
+
+    for (const auto& rc: conditions){
+      ccs.push_back(rc._condition);
+    }
+
+    auto cr = ::std::make_unique<compiled_route>(::std::move(name), ::std::move(definition), ::std::move(ccs));
+    ::std::lock_guard<::std::mutex> l(compiled_conditions_mutex);
+    const compiled_route* r = compiled_routes_map.emplace(key, ::std::move(cr)).first->second.get();
+    thread_compiled_routes.emplace(key, r);
+    return *r;
+  }
+
+} // End namespace interviews.
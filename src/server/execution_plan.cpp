@@ -0,0 +1,243 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <utility>
+
+#include "interviews/execution_plan.hpp"
+
+namespace interviews {
+
+  execution_plan::execution_plan(const questionnaire_r& qq):
+    _version_key(qq->get_version_key()),
+    _valid(true),
+    _memory_size(sizeof(execution_plan) + _version_key.size())
+  {
+    HX2A_ASSERT(qq->is_locked());
+    _questions.reserve(qq->size());
+    // Ordinals of the begin loops enclosing the current question.
+    ::std::vector<size_t> begin_loops;
+
+    // The dependencies are recorded once all the questions are known.
+    struct dependency
+    {
+      size_t _used;
+      size_t _user;
+      question_set question_entry::* _dependents;
+    };
+
+    ::std::vector<dependency> dependencies;
+
+    auto add_dependencies = [&](size_t user, const function_r& f, question_set question_entry::* dependents){
+      for (auto i = f->parameters_cbegin(), e = f->parameters_cend(); i != e; ++i){
+	HX2A_ASSERT(*i);
+	dependencies.push_back({(*i)->get_ordinal(), user, dependents});
+      }
+    };
+
+    size_t qn = 0;
+
+    for (auto i = qq->questions_cbegin(), e = qq->questions_cend(); i != e; ++i){
+      HX2A_ASSERT(*i);
+      question_r q = **i;
+
+      if (q->get_ordinal() != qn){
+	HX2A_LOG(error) << "Question " << q->get_label() << " has ordinal " << q->get_ordinal() << " at position " << qn << ", no execution plan for questionnaire " << _version_key << '.';
+	_valid = false;
+      }
+
+      question_entry qe{q->get_label(), q->get_loop_type(), begin_loops.size(), npos, false, {}, {}, {}, {}, {}};
+
+      switch (qe._loop_type){
+      case question::regular:
+	{
+	  {
+	    question_body_r qb = q->get_body();
+	    qe._context_free = begin_loops.empty() && qb->text_functions_cbegin() == qb->text_functions_cend();
+	  }
+
+	  // Only questions with a body of their own have text functions with parameters, see question::is_impacted_by.
+	  if (question_with_body* qwb = dynamic_cast<question_with_body*>(&q.get())){
+	    question_body_r qb = qwb->get_body();
+
+	    for (auto fi = qb->text_functions_cbegin(), fe = qb->text_functions_cend(); fi != fe; ++fi){
+	      HX2A_ASSERT(*fi);
+	      add_dependencies(qn, **fi, &question_entry::_impacted);
+	    }
+	  }
+
+	  break;
+	}
+
+      case question::begin_loop:
+	{
+	  begin_loops.push_back(qn);
+	  question_begin_loop* qbl = dynamic_cast<question_begin_loop*>(&q.get());
+	  HX2A_ASSERT(qbl);
+	  dependencies.push_back({qbl->get_operand_question()->get_ordinal(), qn, &question_entry::_impacted});
+	  break;
+	}
+
+      case question::end_loop:
+	{
+	  // The compilation of the source questionnaire guarantees that begin/ends are properly balanced.
+	  HX2A_ASSERT(!begin_loops.empty());
+	  size_t bl = begin_loops.back();
+	  begin_loops.pop_back();
+	  qe._loop_depth = begin_loops.size();
+	  qe._matching_loop = bl;
+	  _questions[bl]._matching_loop = qn;
+	  break;
+	}
+      }
+
+      size_t n = 0;
+
+      for (auto ti = q->transitions_cbegin(), te = q->transitions_cend(); ti != te; ++ti){
+	HX2A_ASSERT(*ti);
+	transition_r t = **ti;
+
+	if (function_p if_c = t->get_condition()){
+	  add_dependencies(qn, *if_c, &question_entry::_driven);
+	}
+
+	qe._transition_keys.push_back(transition::make_key(_version_key, qe._label, n));
+	qe._transition_destinations.push_back((*ti)->get_destination()->get_ordinal());
+	_memory_size += qe._transition_keys.back().size() + sizeof(string) + sizeof(size_t);
+	++n;
+      }
+
+      _memory_size += sizeof(question_entry) + 2 * qe._label.size() + sizeof(pair<const string, size_t>) + 2 * sizeof(void*);
+      _ordinals_by_label.emplace(qe._label, qn);
+      _questions.push_back(::std::move(qe));
+      ++qn;
+    }
+
+    // Questions only use answers to preceding questions, but the graph does not rely on it.
+    for (const auto& d: dependencies){
+      if (d._used >= _questions.size()){
+	HX2A_LOG(error) << "Question " << _questions[d._user]._label << " depends on an unknown question ordinal " << d._used << ", no execution plan for questionnaire " << _version_key << '.';
+	_valid = false;
+	continue;
+      }
+
+      question_set& dependents = _questions[d._used].*d._dependents;
+      question_set& used = _questions[d._user]._dependencies;
+      size_t ms = dependents.get_memory_size() + used.get_memory_size();
+      dependents.insert(d._user);
+      used.insert(d._used);
+      _memory_size += dependents.get_memory_size() + used.get_memory_size() - ms;
+    }
+  }
+
+  namespace {
+
+    // Plans are small, a few kilobytes for large questionnaires, plus their dependency graphs which are usually sparse.
+    constexpr size_t execution_plans_capacity = 64 << 20;
+    size_t execution_plans_size = 0;
+
+    // A plan in the registry, with the time it was last used. Threads using the plan from their own cache update the
+    // time too, without locking, so that the plans they use are not evicted in their back.
+    struct registered_execution_plan
+    {
+      registered_execution_plan(::std::shared_ptr<const execution_plan> p):
+	_plan(::std::move(p)),
+	_last_use(now())
+      {
+      }
+
+      static int64_t now(){
+	return ::std::chrono::steady_clock::now().time_since_epoch().count();
+      }
+
+      void touch(){
+	_last_use.store(now(), ::std::memory_order_relaxed);
+      }
+
+      ::std::shared_ptr<const execution_plan> _plan;
+      ::std::atomic<int64_t> _last_use;
+    };
+
+    ::std::mutex execution_plans_mutex;
+    ::std::unordered_map<string, ::std::shared_ptr<registered_execution_plan>> execution_plans_map;
+
+    // The plans used by the thread, in front of the registry. Threads keep them alive after their eviction from the
+    // registry, so their number is bounded too.
+    constexpr size_t thread_execution_plans_max_size = 16;
+    thread_local ::std::unordered_map<string, ::std::shared_ptr<registered_execution_plan>> thread_execution_plans;
+
+    // Must be called under the lock. Evicts the least recently used plans. Evictions only happen when a new plan is
+    // built, scanning the registry then is negligible.
+    void evict_execution_plans(){
+      while (execution_plans_size > execution_plans_capacity && !execution_plans_map.empty()){
+	auto lru = execution_plans_map.begin();
+
+	for (auto i = ::std::next(lru), e = execution_plans_map.end(); i != e; ++i){
+	  if (i->second->_last_use.load(::std::memory_order_relaxed) < lru->second->_last_use.load(::std::memory_order_relaxed)){
+	    lru = i;
+	  }
+	}
+
+	execution_plans_size -= lru->second->_plan->get_memory_size();
+	execution_plans_map.erase(lru);
+      }
+    }
+
+  } // End anonymous namespace.
+
+  ::std::shared_ptr<const execution_plan> execution_plans::get(const questionnaire_r& qq){
+    string key = qq->get_version_key();
+
+    if (key.empty()){
+      return {};
+    }
+
+    // Plans are immutable, the ones the thread already has are used without locking.
+    if (auto f = thread_execution_plans.find(key); f != thread_execution_plans.cend()){
+      f->second->touch();
+      const auto& p = f->second->_plan;
+      return p->is_valid() ? p : nullptr;
+    }
+
+    ::std::shared_ptr<registered_execution_plan> rp;
+
+    {
+      ::std::lock_guard<::std::mutex> l(execution_plans_mutex);
+
+      if (auto f = execution_plans_map.find(key); f != execution_plans_map.cend()){
+	rp = f->second;
+	rp->touch();
+      }
+    }
+
+    if (!rp){
+      // Building outside the lock. In the unlikely case two threads build the same plan, the first registered wins.
+      rp = ::std::make_shared<registered_execution_plan>(::std::make_shared<const execution_plan>(qq));
+      ::std::lock_guard<::std::mutex> l(execution_plans_mutex);
+      auto [f, inserted] = execution_plans_map.emplace(key, rp);
+
+      if (inserted){
+	execution_plans_size += rp->_plan->get_memory_size();
+	// Keeping our own copy, the plan might be evicted right away if it is larger than the capacity.
+	evict_execution_plans();
+      }
+      else{
+	rp = f->second;
+      }
+    }
+
+    if (thread_execution_plans.size() >= thread_execution_plans_max_size){
+      thread_execution_plans.clear();
+    }
+
+    thread_execution_plans.emplace(::std::move(key), rp);
+    const auto& p = rp->_plan;
+    return p->is_valid() ? p : nullptr;
+  }
+
+} // End namespace interviews.
@@ -0,0 +1,232 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#include <cctype>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "interviews/loop_operand.hpp"
+
+namespace interviews {
+
+  namespace {
+
+    bool is_identifier_start(char c){
+      return isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+    }
+
+    bool is_identifier_part(char c){
+      return is_identifier_start(c) || isdigit(static_cast<unsigned char>(c));
+    }
+
+    void skip_spaces(string_view s, size_t& i){
+      while (i != s.size() && isspace(static_cast<unsigned char>(s[i]))){
+	++i;
+      }
+    }
+
+    // Returns an empty string if there is no identifier at the position.
+    string_view read_identifier(string_view s, size_t& i){
+      if (i == s.size() || !is_identifier_start(s[i])){
+	return {};
+      }
+
+      size_t b = i;
+
+      while (i != s.size() && is_identifier_part(s[i])){
+	++i;
+      }
+
+      return s.substr(b, i - b);
+    }
+
+    // Indices are bounded well below any loop operand size. Longer ones are left to V8.
+    constexpr size_t index_max_digits = 9;
+
+  } // End anonymous namespace.
+
+  ::std::optional<loop_operand_path> loop_operand_path::parse(string_view operand){
+    loop_operand_path rtnd;
+    size_t i = 0;
+    skip_spaces(operand, i);
+
+    if (read_identifier(operand, i) != "R"){
+      return {};
+    }
+
+    skip_spaces(operand, i);
+
+    if (i == operand.size() || operand[i] != '='){
+      return {};
+    }
+
+    ++i;
+    skip_spaces(operand, i);
+    // Also rejects a comparison, as the second equal sign is not an identifier.
+    rtnd._root = string(read_identifier(operand, i));
+
+    if (rtnd._root.empty()){
+      return {};
+    }
+
+    while (true){
+      skip_spaces(operand, i);
+
+      if (i == operand.size()){
+	break;
+      }
+
+      if (operand[i] == '.'){
+	++i;
+	skip_spaces(operand, i);
+	string_view m = read_identifier(operand, i);
+
+	// An own __proto__ member is not what JavaScript returns.
+	if (m.empty() || m == "__proto__"){
+	  return {};
+	}
+
+	rtnd._steps.push_back({string(m), 0});
+	continue;
+      }
+
+      if (operand[i] == '['){
+	++i;
+	skip_spaces(operand, i);
+	size_t b = i;
+	size_t index = 0;
+
+	while (i != operand.size() && isdigit(static_cast<unsigned char>(operand[i]))){
+	  index = index * 10 + (operand[i] - '0');
+	  ++i;
+	}
+
+	size_t digits = i - b;
+
+	// Leading zeros are octal literals, rejected in strict mode.
+	if (!digits || digits > index_max_digits || (digits > 1 && operand[b] == '0')){
+	  return {};
+	}
+
+	skip_spaces(operand, i);
+
+	if (i == operand.size() || operand[i] != ']'){
+	  return {};
+	}
+
+	++i;
+	rtnd._steps.push_back({{}, index});
+	continue;
+      }
+
+      break;
+    }
+
+    if (i != operand.size() && operand[i] == ';'){
+      ++i;
+      skip_spaces(operand, i);
+    }
+
+    if (i != operand.size()){
+      return {};
+    }
+
+    return rtnd;
+  }
+
+  ::std::optional<json::value> loop_operand_path::apply(const json::value& root) const {
+    // Null for undefined.
+    const json::value* v = &root;
+
+    for (const auto& s: _steps){
+      if (!v){
+	// A TypeError in JavaScript.
+	return {};
+      }
+
+      if (!s._member.empty()){
+	const json::object_type* obj = v->if_object();
+
+	if (!obj){
+	  // Array and string properties, or a TypeError on null.
+	  return {};
+	}
+
+	auto f = obj->find(s._member);
+
+	if (f == obj->cend()){
+	  // The member might be a prototype property.
+	  return {};
+	}
+
+	v = &f->second;
+	continue;
+      }
+
+      const json::array_type* arr = v->if_array();
+
+      if (!arr){
+	return {};
+      }
+
+      v = s._index < arr->size() ? &(*arr)[s._index] : nullptr;
+    }
+
+    if (!v){
+      return json::value();
+    }
+
+    return *v;
+  }
+
+  namespace {
+
+    // Operands belong to questionnaires, and like compiled conditions they are never removed from the registry, so
+    // their addresses are stable.
+    ::std::mutex loop_operand_paths_mutex;
+    // Operands which are not paths are registered too, with a null path.
+    ::std::unordered_map<string, ::std::unique_ptr<const loop_operand_path>> loop_operand_paths_map;
+
+    // The operands the thread already looked up, in front of the registry, so that starting loops takes no lock.
+    thread_local ::std::unordered_map<string, const loop_operand_path*> thread_loop_operand_paths;
+
+  } // End anonymous namespace.
+
+  const loop_operand_path* loop_operand_paths::get(const string& operand){
+    if (auto f = thread_loop_operand_paths.find(operand); f != thread_loop_operand_paths.cend()){
+      return f->second;
+    }
+
+    const loop_operand_path* p = nullptr;
+    bool found = false;
+
+    {
+      ::std::lock_guard<::std::mutex> l(loop_operand_paths_mutex);
+
+      if (auto f = loop_operand_paths_map.find(operand); f != loop_operand_paths_map.cend()){
+	p = f->second.get();
+	found = true;
+      }
+    }
+
+    if (!found){
+      // Parsing outside the lock. In the unlikely case two threads parse the same operand, the first registered wins.
+      ::std::unique_ptr<const loop_operand_path> lop;
+
+      if (::std::optional<loop_operand_path> op = loop_operand_path::parse(operand)){
+	lop = ::std::make_unique<const loop_operand_path>(::std::move(*op));
+      }
+
+      ::std::lock_guard<::std::mutex> l(loop_operand_paths_mutex);
+      p = loop_operand_paths_map.emplace(operand, ::std::move(lop)).first->second.get();
+    }
+
+    thread_loop_operand_paths.emplace(operand, p);
+    return p;
+  }
+
+} // End namespace interviews.
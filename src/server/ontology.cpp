@@ -4,7 +4,9 @@
 //
 
 #include <algorithm>
+#include <atomic>
 #include <iterator>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <unordered_map>
@@ -15,8 +17,12 @@
 #include "hx2a/checked_cast.hpp"
 #include "hx2a/v8.hpp"
 
+#include "interviews/conditions.hpp"
 #include "interviews/exception.hpp"
+#include "interviews/execution_plan.hpp"
+#include "interviews/loop_operand.hpp"
 #include "interviews/ontology.hpp"
+#include "interviews/parametric_text.hpp"
 #include "interviews/payloads.hpp"
 
 // Design notes:
@@ -26,28 +32,92 @@
 
 namespace interviews {
 
-  static inline void inject_loop_operand(const the_stack& ts, language_t lang, ostringstream& oc, const question_begin_loop_r& qbl, const answer_r& loop_operand_answer){
-    // Let's obtain the vector we are iterating upon. We need the localized answer, as the loop variable is
-    // typically used in parametric text.
-    localized_answer_data_r lad = loop_operand_answer->make_localized_answer_data(ts, lang);
-    // Must serialize the localized answer data to inject the value in V8 code to calculate the JSON vector.
+  // Reference construction of the JSON values injected in JavaScript code: the payload is serialized and parsed back, and its
+  // polymorphic type tag is removed. Only used in debug mode to check the direct construction.
+  template <typename PayloadType>
+  static json::value make_untagged_value(const rfr<PayloadType>& p){
     json::ostream<> jo;
-    node_traits<localized_answer_data>::payload_serialize(jo, lad.get());
-    // Parsing it into a JSON value to be able to remove the polymorphic type tag.
+    node_traits<PayloadType>::payload_serialize(jo, p.get());
     json::value v = json::value::read<no_line_count, pretty>(jo.str());
     HX2A_ASSERT(v.if_object());
     const json::object_type& vobj = *v.if_object();
-    // Only one key, the dollar-prefixed type tag. The base answer data type is never
-    // instantiated.
+    // Only one key, the dollar-prefixed type tag. The base type is never instantiated.
     HX2A_ASSERT(vobj.size() == 1);
     HX2A_ASSERT(vobj.cbegin()->first.size() != 0);
     HX2A_ASSERT(vobj.cbegin()->first[0] == '$');
-    // Removal of the '$' key from the JSON value.
-    v = vobj.cbegin()->second;
-    oc << "let " << lad->_label.get() << '=' << v << ';' << qbl->get_operand() << ';'; 
+    return vobj.cbegin()->second;
+  }
+
+  // Returns the answer data as a JSON value, without the polymorphic type tag. Conditions operate on the exact same data
+  // as the ones in downloaded interviews.
+  // Memoized on the stack for the duration of the request.
+  static inline const json::value& make_answer_argument(const the_stack& ts, const answer_r& a, time_t start_timestamp, const string& start_ip_address){
+    return ts.get_argument(a, false, {}, [&](){
+      json::value v = a->make_answer_value(start_timestamp, start_ip_address);
+
+      if constexpr (debug_mode){
+	HX2A_ASSERT(v == make_untagged_value(a->make_answer_data(start_timestamp, start_ip_address)));
+      }
+
+      return v;
+    });
+  }
+
+  // Same with the localized answer data, which are richer than mere answer data, so that localized labels can be used in
+  // parametric texts.
+  static inline const json::value& make_localized_answer_argument(const the_stack& ts, language_t lang, const answer_r& a){
+    return ts.get_argument(a, true, lang, [&](){
+      json::value v = a->make_localized_answer_value(ts, lang);
+
+      if constexpr (debug_mode){
+	HX2A_ASSERT(v == make_untagged_value(a->make_localized_answer_data(ts, lang)));
+      }
+
+      return v;
+    });
+  }
+  
+  static inline void inject_loop_operand(const the_stack& ts, language_t lang, ostringstream& oc, const question_begin_loop_r& qbl, const answer_r& loop_operand_answer){
+    // Let's obtain the vector we are iterating upon. We need the localized answer, as the loop variable is
+    // typically used in parametric text.
+    const json::value& v = make_localized_answer_argument(ts, lang, loop_operand_answer);
+    oc << "let " << loop_operand_answer->get_label() << '=' << v << ';' << qbl->get_operand() << ';'; 
   }
   
+  // Reports the V8 call for the question started at the time given if it is close to the budget or over it. The
+  // compiled conditions evaluated, if any, count it. Calls over the budget are logged too, and fail the request if the
+  // budget is enforced.
+  static void report_javascript_budget(const string& label, javascript_budget::clock::time_point start, const ::std::vector<const compiled_condition*>& ccs = {}){
+    javascript_budget::status_t s = javascript_budget::check(start);
+
+    if (s == javascript_budget::within){
+      return;
+    }
+
+    for (const compiled_condition* cc: ccs){
+      cc->count_slow_run();
+    }
+
+    if (s == javascript_budget::exceeded){
+      HX2A_LOG(error) << "JavaScript evaluation for question " << label << " exceeded its time budget.";
+
+      if (javascript_budget::enforcement::is_enforced()){
+	throw javascript_budget_exceeded(label);
+      }
+    }
+    else if (ccs.empty()){
+      HX2A_LOG(trace) << "JavaScript evaluation for question " << label << " is close to its time budget.";
+    }
+  }
+
   static inline json::value compute_loop_operand(const the_stack& ts, language_t lang, const question_begin_loop_r& qbl, const answer_r& loop_operand_answer){
+    // Most operands are mere paths into the answer, applied natively.
+    if (auto p = loop_operand_paths::get(qbl->get_operand()); p && p->get_root() == loop_operand_answer->get_label()){
+      if (::std::optional<json::value> v = p->apply(make_localized_answer_argument(ts, lang, loop_operand_answer))){
+	return ::std::move(*v);
+      }
+    }
+
     ostringstream oc;
     // Remember that undefined is not parsed as a result from a V8 call. We must not return it. Hence the complexity on testing
     // undefined.
@@ -57,24 +127,91 @@ namespace interviews {
     inject_loop_operand(ts, lang, oc, qbl, loop_operand_answer);
     // We are paranoid, the loop operand calculation might have assigned undefined to R.
     oc << "if(R==undefined){null}else R}";
-    return v8_execute(oc.str());
+    auto start = javascript_budget::clock::now();
+    json::value rtnd = v8_execute(oc.str());
+    report_javascript_budget(qbl->get_label(), start);
+    return rtnd;
   }
   
   json::value the_stack_frame::calculate_loop_operand(const the_stack& ts, language_t lang) const {
     return compute_loop_operand(ts, lang, _question_begin_loop, _loop_operand_answer);
   }
-  
-  json::value the_stack_frame::calculate_loop_variable_value(const the_stack& ts, language_t lang, const question_begin_loop_r& qbl, const answer_r& loop_operand_answer, size_t index){
-    ostringstream oc;
-    // Remember that undefined is not parsed as a result from a V8 call. We must not return it. Hence the complexity on testing
-    // undefined.
-    // let because we're compiling the code in a strict way and var would pollute the globals, as we reuse V8's heap.
-    // Opening a brace for the same.
-    oc << "{let R=null;";
-    inject_loop_operand(ts, lang, oc, qbl, loop_operand_answer);
-    // We are paranoid, the loop operand calculation might have assigned undefined to R.
-    oc << "if(R==undefined){null}else{R=R[" << index << "];if(R==undefined){null}else R}}";
-    return v8_execute(oc.str());
+
+  the_stack_frame::the_stack_frame(const stack_snapshot_frame_r& ssf):
+    _question_begin_loop(ssf->get_question_begin_loop()),
+    _loop_operand_answer(ssf->get_loop_operand_answer()),
+    _index(ssf->get_index())
+  {
+    set_loop_operand(json::value::read<no_line_count, pretty>(ssf->get_loop_operand()));
+    HX2A_ASSERT(_index < _loop_operand_size);
+
+    if (language_t lang = ssf->get_loop_operand_language(); lang != language::nil()){
+      _loop_operand_language = lang;
+    }
+  }
+
+  // The answers are added by the stack.
+  stack_snapshot_frame_r the_stack_frame::make_snapshot() const {
+    ostringstream os;
+    os << _loop_operand;
+    return make<stack_snapshot_frame>(_question_begin_loop, _loop_operand_answer, os.str(), _loop_operand_language.value_or(language::nil()), _index);
+  }
+
+  stack_snapshot_r the_stack::make_snapshot(size_t history_size) const {
+    // Frames only know the answers they hid. Walking from the innermost frame, the answers of a frame are the ones visible
+    // at its level, and what it hid is visible at the enclosing level.
+    answers_type visible = _answers;
+    ::std::vector<stack_snapshot_frame_r> frames;
+    frames.reserve(_vector.size());
+    
+    for (auto i = _vector.crbegin(), e = _vector.crend(); i != e; ++i){
+      stack_snapshot_frame_r ssf = i->make_snapshot();
+
+      for (auto si = i->shadowed_answers_cbegin(), se = i->shadowed_answers_cend(); si != se; ++si){
+	answer_p& a = visible[si->_position];
+	HX2A_ASSERT(a);
+	ssf->push_answer_back(*a);
+	a = si->_answer;
+      }
+
+      frames.push_back(ssf);
+    }
+    
+    stack_snapshot_r ss = make<stack_snapshot>(history_size);
+
+    for (const auto& a: visible){
+      if (a){
+	ss->push_answer_back(*a);
+      }
+    }
+
+    for (auto i = frames.crbegin(), e = frames.crend(); i != e; ++i){
+      ss->push_frame_back(*i);
+    }
+
+    return ss;
+  }
+
+  void the_stack::restore(const stack_snapshot_r& ss){
+    HX2A_ASSERT(_vector.empty());
+    HX2A_ASSERT(_answers.empty());
+    
+    for (auto i = ss->answers_cbegin(), e = ss->answers_cend(); i != e; ++i){
+      HX2A_ASSERT(*i);
+      replace_answer(**i);
+    }
+
+    // Replacing the answers after pushing each frame records what they hide.
+    for (auto i = ss->frames_cbegin(), e = ss->frames_cend(); i != e; ++i){
+      HX2A_ASSERT(*i);
+      stack_snapshot_frame_r ssf = **i;
+      _vector.emplace_back(ssf);
+
+      for (auto ai = ssf->answers_cbegin(), ae = ssf->answers_cend(); ai != ae; ++ai){
+	HX2A_ASSERT(*ai);
+	replace_answer(**ai);
+      }
+    }
   }
   
   json::value function::call(language_t lang){
@@ -89,7 +226,28 @@ namespace interviews {
     return slot_js_run(_code);
   }
   
-  question_p transition::run(const the_stack& ts, time_t start_timestamp){
+  ::std::vector<const question*> transition::get_distinct_parameters() const {
+    HX2A_ASSERT(_condition);
+    ::std::vector<const question*> rtnd;
+    auto i = _condition->parameters_cbegin();
+    auto e = _condition->parameters_cend();
+
+    while (i != e){
+      question_p if_q = *i;
+      HX2A_ASSERT(if_q);
+      const question* q = if_q.get();
+
+      if (::std::find(rtnd.cbegin(), rtnd.cend(), q) == rtnd.cend()){
+	rtnd.push_back(q);
+      }
+
+      ++i;
+    }
+
+    return rtnd;
+  }
+
+  question_p transition::run(const the_stack& ts, time_t start_timestamp, const string& start_ip_address, const string& question_label){
     if (!_condition || _condition->empty()){
       return _destination;
     }
@@ -105,26 +263,8 @@ namespace interviews {
       question_r q = *if_q;
       
       if (answer_p if_a = ts.find_answer(q)){
-	answer_r a = *if_a;
 	// The questionnaire might have skipped the answer, in that case the parameter will be set to null.
-	answer_data_r ad = a->make_answer_data(start_timestamp);
-	// Serializing the answer data as a payload. Reusing the same type for downloading
-	// interviews guarantees that downloaded interviews and conditions operate on the
-	// exact same data.
-	json::ostream<> jo;
-	node_traits<answer_data>::payload_serialize(jo, ad.get());
-	// Parsing it into a JSON value to be able to remove the polymorphic type tag.
-	json::value v = json::value::read<no_line_count, pretty>(jo.str());
-	HX2A_ASSERT(v.if_object());
-	const json::object_type& vobj = *v.if_object();
-	// Only one key, the dollar-prefixed type tag. The base answer data type is never
-	// instantiated.
-	HX2A_ASSERT(vobj.size() == 1);
-	HX2A_ASSERT(vobj.cbegin()->first.size() != 0);
-	HX2A_ASSERT(vobj.cbegin()->first[0] == '$');
-	// Removal of the '$' key from the JSON value.
-	v = vobj.cbegin()->second;
-	_condition->push_argument(q->get_label(), v);
+	_condition->push_argument(q->get_label(), make_answer_argument(ts, *if_a, start_timestamp, start_ip_address));
       }
       else{
 	_condition->push_argument(q->get_label(), json::value());
@@ -133,7 +273,9 @@ namespace interviews {
       ++i;
     }
 
+    auto start = javascript_budget::clock::now();
     json::value v = _condition->call();
+    report_javascript_budget(question_label, start);
     
     if (json::is_true(v)){
       return _destination;
@@ -160,13 +302,167 @@ namespace interviews {
     }
   }
 
-  question_r question::run_transitions(const the_stack& ts, time_t start_timestamp) const {
+  question_r question::run_transitions(const the_stack& ts, time_t start_timestamp, const string& start_ip_address, const execution_plan* plan) const {
+    if (!plan){
+      for (const auto& t: _transitions){
+	HX2A_ASSERT(t);
+
+	if (question_p q = t->run(ts, start_timestamp, start_ip_address, get_label())){
+	  return *q;
+	}
+      }
+
+      // The only question which has no catch all is the final one and we're not supposed to run its transitions.
+      HX2A_ASSERT(false);
+      throw internal_error();
+    }
+
+    const execution_plan::question_entry& qe = plan->get_question(get_ordinal());
+    HX2A_ASSERT(qe._transition_keys.size() == _transitions.size());
+    ::std::vector<transition_r> transitions;
+    transitions.reserve(_transitions.size());
+    // The union of the parameters of the conditions, so that the arguments are made once for all the transitions.
+    ::std::vector<const question*> parameters;
+    ::std::vector<compiled_conditions::route_condition> conditions;
+
     for (const auto& t: _transitions){
       HX2A_ASSERT(t);
+      size_t n = transitions.size();
+      transitions.push_back(*t);
+      function_p c = t->get_condition();
+
+      if (!c || c->empty()){
+	continue;
+      }
+
+      compiled_conditions::route_condition rc{n, nullptr, {}};
+      ::std::vector<string> labels;
+
+      for (const question* q: t->get_distinct_parameters()){
+	auto f = ::std::find(parameters.cbegin(), parameters.cend(), q);
+	rc._arguments.push_back(f - parameters.cbegin());
+
+	if (f == parameters.cend()){
+	  parameters.push_back(q);
+	}
+
+	labels.push_back(q->get_label());
+      }
+
+      rc._condition = &compiled_conditions::get(qe._transition_keys[n], c->get_code(), labels);
+      conditions.push_back(::std::move(rc));
+    }
+
+    // Made on demand, as the first transitions often decide. The stack memoizes them, the references remain valid.
+    ::std::vector<const json::value*> args(parameters.size(), nullptr);
+    static const json::value null_argument;
+
+    auto argument = [&](size_t a) -> const json::value& {
+      const json::value*& v = args[a];
+
+      if (!v){
+	// The questionnaire might have skipped the answer, in that case the argument will be null.
+	if (answer_p if_a = ts.find_answer(*parameters[a])){
+	  v = &make_answer_argument(ts, *if_a, start_timestamp, start_ip_address);
+	}
+	else{
+	  v = &null_argument;
+	}
+      }
+
+      return *v;
+    };
+
+    expression::arguments cargs;
+    size_t ci = 0;
+
+    for (size_t n = 0; n != transitions.size(); ++n){
+      if (ci == conditions.size() || conditions[ci]._position != n){
+	// Unconditional.
+	return transitions[n]->get_destination();
+      }
+
+      const auto& rc = conditions[ci];
+
+      // Trying the native evaluation first, if the condition is simple enough.
+      if (const auto& ex = rc._condition->get_expression()){
+	cargs.clear();
+
+	for (size_t a: rc._arguments){
+	  cargs.push_back(argument(a));
+	}
+
+	if (::std::optional<bool> b = ex->evaluate(cargs)){
+	  rc._condition->count_native_run();
+
+	  if (*b){
+	    return transitions[n]->get_destination();
+	  }
+
+	  ++ci;
+	  continue;
+	}
+      }
+
+      // This condition and the following ones, up to the next unconditional transition, are run in a single call.
+      size_t ce = ci + 1;
+
+      while (ce != conditions.size() && conditions[ce]._position == conditions[ce - 1]._position + 1){
+	++ce;
+      }
+
+      size_t last = conditions[ce - 1]._position + 1;
+      // Only the arguments of the conditions in the range are made, the others are not used by the call.
+      ::std::vector<bool> used(parameters.size(), false);
+
+      for (size_t i = ci; i != ce; ++i){
+	for (size_t a: conditions[i]._arguments){
+	  used[a] = true;
+	}
+      }
+
+      const compiled_route& cr = compiled_conditions::get_route(plan->get_version_key() + '/' + get_label(), conditions);
+      cr.define();
+      ostringstream oc;
+      oc << cr.get_function_name() << '(' << n << ',' << last;
+
+      for (size_t a = 0; a != parameters.size(); ++a){
+	if (used[a]){
+	  oc << ',' << argument(a);
+	}
+	else{
+	  oc << ",null";
+	}
+      }
+
+      oc << ')';
+      auto start = javascript_budget::clock::now();
+      json::value v = v8_execute(oc.str());
+      const double* d = v.if_double();
+
+      if (!d || (*d >= 0 && (*d < n || *d >= last))){
+	HX2A_LOG(error) << "Route of question " << get_label() << " returned " << v << '.';
+	throw internal_error();
+      }
+
+      size_t found = *d < 0 ? last : static_cast<size_t>(*d);
 
-      if (question_p q = t->run(ts, start_timestamp)){
-	return *q;
+      // The conditions run by V8 count the call if it is close to the budget.
+      ::std::vector<const compiled_condition*> evaluated;
+
+      for (size_t i = ci; i != ce && conditions[i]._position <= found; ++i){
+	conditions[i]._condition->count_v8_run();
+	evaluated.push_back(conditions[i]._condition);
+      }
+
+      report_javascript_budget(get_label(), start, evaluated);
+
+      if (found != last){
+	return transitions[found]->get_destination();
       }
+
+      ci = ce;
+      n = last - 1;
     }
 
     // The only question which has no catch all is the final one and we're not supposed to run its transitions.
@@ -231,202 +527,105 @@ namespace interviews {
 				       const string& text
 				       ) const {
     // Checking if we are in the most common case, to process it quickly.
-    if (_text_functions.empty() && ts.empty()){
+    if ((_text_functions.empty() && ts.empty()) || parametric_text::is_literal(text)){
       return text;
     }
 
+    ::std::shared_ptr<const parametric_text> pt = parametric_texts::get(text);
     // Keeping the function call values somewhere in case they are used several times.
     ::std::vector<::std::optional<json::value>> function_call_values(_text_functions.size());
-    // This is the calculated text stream.
-    ostringstream s;
-    
-    auto i = text.cbegin();
-    auto e = text.cend();
-
-    while (i != e){
-      char c = *i;
-	
-      if (c == eval_prefix){
-	++i;
+    // This is the calculated text.
+    string s;
+    s.reserve(pt->get_literals_size() + 16 * pt->get_segments().size());
+
+    // If it is a string, we must trim the double quotes around.
+    auto append_value = [&s](const json::value& v){
+      if (const string* str = v.if_string()){
+	s += *str;
+      }
+      else{
+	ostringstream os;
+	os << v;
+	s += os.str();
+      }
+    };
 
-	if (i == e){
-	  s << eval_prefix;
+    for (const auto& seg: pt->get_segments()){
+      switch (seg._kind){
+      case parametric_text::segment::literal:
+	{
+	  s += seg._value;
 	  break;
 	}
 
-	c = *i;
-	
-	if (c == eval_open){
-	  // Read @{, need to accumulate the function number or the loop variable name.
-	  ++i;
+      case parametric_text::segment::function_call:
+	{
+	  size_t funcn = seg._function;
 
-	  if (i == e){
-	    s << eval_open;
-	    break;
+	  // Probably already checked, belt and suspenders.
+	  if (funcn >= _text_functions.size()){
+	    throw function_call_out_of_bounds(label);
 	  }
-
-	  c = *i;
-
-	  if (isdigit(c)){
-	    // Just in case we abort, we keep a "side" stream going.
-	    bool abort = false;
-	    ostringstream ss;
-	    ss << eval_prefix << eval_open << c;
-	    uint64_t funcn = c - '0';
 	    
-	    do {
-	      ++i;
-	      
-	      if (i == e){
-		abort = true;
-		break;
-	      }
-	      
-	      c = *i;
-
-	      if (!isdigit(c)){
-		abort = (c != eval_close);
-		break;
-	      }
-
-	      ss << c;
-	      // We let funny things happen in case of overflow. We do not check.
-	      funcn += funcn * 10 + c - '0';
-	    } while (true);
-
-	    if (abort){
-	      s << ss.str();
-	      break;
-	    }
-
-	    HX2A_ASSERT(c ==  eval_close);
+	  // Must call the function and insert the result in the text.
+	  if (function_call_values[funcn]){
+	    // The function was already called, let's reuse the result.
+	    append_value(*function_call_values[funcn]);
+	    break;
+	  }
 
-	    // Probably already checked, belt and suspenders.
-	    if (funcn >= _text_functions.size()){
-	      throw function_call_out_of_bounds(label);
-	    }
-	    
-	    // Must call the function and insert the result in the stream.
-	    if (function_call_values[funcn]){
-	      // The function was already called, let's reuse the result.
-	      s << *function_call_values[funcn];
-	    }
-	    else{
-	      // We must push the arguments, call the function, record the result, and insert it.
-	      function_p if_func = _text_functions[funcn];
-	      HX2A_ASSERT(if_func);
-	      function_r func = *if_func;
+	  // We must push the arguments, call the function, record the result, and insert it.
+	  function_p if_func = _text_functions[funcn];
+	  HX2A_ASSERT(if_func);
+	  function_r func = *if_func;
 	      
-	      // Inserting the arguments. Using the localized answer data, which are richer than mere answer data.
-	      auto i = func->parameters_cbegin();
-	      auto e = func->parameters_cend();
+	  // Inserting the arguments. Using the localized answer data, which are richer than mere answer data.
+	  auto i = func->parameters_cbegin();
+	  auto e = func->parameters_cend();
 	      
-	      while (i != e){
-		question_p if_q = *i;
-		HX2A_ASSERT(if_q);
-		question_r q = *if_q;
-		
-		if (answer_p a = ts.find_answer(q)){
-		  // The questionnaire might have skipped the answer, in that case the parameter will be set to null.
-		  // Using localized answer data so that localized labels can be used in the JavaScript code and serialized in the
-		  // parametric text.
-		  localized_answer_data_r lad = (*a)->make_localized_answer_data(ts, lang);
-		  // Serializing the localized answer data as a payload. Reusing the same type for downloading
-		  // interviews guarantees that downloaded interviews and conditions operate on the exact same data.
-		  json::ostream<> jo;
-		  node_traits<localized_answer_data>::payload_serialize(jo, lad.get());
-		  // Parsing it into a JSON value to be able to remove the polymorphic type tag.
-		  json::value v = json::value::read<no_line_count, pretty>(jo.str());
-		  HX2A_ASSERT(v.if_object());
-		  const json::object_type& vobj = *v.if_object();
-		  // Only one key, the dollar-prefixed type tag. The base answer data type is never
-		  // instantiated.
-		  HX2A_ASSERT(vobj.size() == 1);
-		  HX2A_ASSERT(vobj.cbegin()->first.size() != 0);
-		  HX2A_ASSERT(vobj.cbegin()->first[0] == '$');
-		  // Removal of the '$' key from the JSON value.
-		  v = vobj.cbegin()->second;
-		  func->push_argument(q->get_label(), v);
-		}
-		else{
-		  func->push_argument(q->get_label(), json::value());
-		}
+	  while (i != e){
+	    question_p if_q = *i;
+	    HX2A_ASSERT(if_q);
+	    question_r q = *if_q;
 		
-		++i;
-	      } // End while.
-
-	      {
-		// We could also add loop variables by passing the stack.
-		json::value v = func->call(lang);
-	      
-		// If it is a string, we must trim the double quotes around.
-		if (const string* str = v.if_string()){
-		  s << *str;
-		}
-		else{
-		  s << v;
-		}
-
-		// Recording the returned value of the call to reuse it if necessary.
-		function_call_values[funcn] = std::move(v);
-	      }
+	    if (answer_p a = ts.find_answer(q)){
+	      // The questionnaire might have skipped the answer, in that case the parameter will be set to null.
+	      // Using localized answer data so that localized labels can be used in the JavaScript code and serialized in the
+	      // parametric text.
+	      func->push_argument(q->get_label(), make_localized_answer_argument(ts, lang, *a));
 	    }
-	  } // End if (isdigit(c)).
-	  else{
-	    // It seems we're starting a loop variable access.
-	    ostringstream vars;
-	    vars << c;
-	    
-	    do {
-	      ++i;
-	      
-	      if (i == e){
-		break;
-	      }
-	      
-	      c = *i;
-
-	      if (c == eval_close){
-		break;
-	      }
-
-	      // We let funny things happen in case of overflow. We do not check.
-	      vars << c;
-	    } while (true);
-
-	    if (i == e){
-	      s << eval_prefix << eval_open << vars.str();
-	      break;
+	    else{
+	      func->push_argument(q->get_label(), json::value());
 	    }
+		
+	    ++i;
+	  } // End while.
+
+	  // We could also add loop variables by passing the stack.
+	  auto start = javascript_budget::clock::now();
+	  json::value v = func->call(lang);
+	  report_javascript_budget(label, start);
+	  append_value(v);
+	  // Recording the returned value of the call to reuse it if necessary.
+	  function_call_values[funcn] = std::move(v);
+	  break;
+	}
 
-	    HX2A_ASSERT(c == eval_close);
-	    string var(vars.str());
-	    json::value v = ts.get_loop_variable(lang, var);
+      case parametric_text::segment::loop_variable:
+	{
+	  json::value v = ts.get_loop_variable(lang, seg._value);
 
-	    if (!v){
-	      throw question_loop_variable_unknown(label);
-	    }
-	    
-	    if (const string* str = v.if_string()){
-	      s << *str;
-	    }
-	    else{
-	      s << v;
-	    }
+	  if (!v){
+	    throw question_loop_variable_unknown(label);
 	  }
-	} // End if (c == eval_open).
-	else{
-	  s << c;
+
+	  append_value(v);
+	  break;
 	}
       }
-      else{
-	s << c;
-      }
-      
-      ++i;
-    } // End while.
+    }
     
-    return string(s.str());
+    return s;
   }
 
   template_question_p template_question::find(const db::connector& cn, const string& label){
@@ -448,6 +647,21 @@ namespace interviews {
     return r.front().get_doc();
   }
   
+  string questionnaire::get_version_key() const {
+    if (!is_locked()){
+      return {};
+    }
+
+    // A locked questionnaire does not change, the key is built once per document.
+    if (_version_key.empty()){
+      ostringstream o;
+      o << get_id() << '.' << _change_count.get();
+      _version_key = o.str();
+    }
+    
+    return _version_key;
+  }
+  
   void questionnaire::check() const {
     if (is_locked()){
       return;
@@ -960,7 +1174,53 @@ namespace interviews {
     return sqft;
   }
   
+  namespace {
+
+    // Only there to protect against unbounded growth, there are not many template question localizations.
+    constexpr size_t template_question_localizations_cache_max_size = 1 << 16;
+
+    // Document identifiers of template question localizations per template question identifier and language. Documents
+    // themselves are not shared across requests.
+    ::std::mutex template_question_localizations_cache_mutex;
+    ::std::unordered_map<string, pair<doc_id, uint64_t>> template_question_localizations_cache;
+    ::std::atomic<uint64_t> template_question_localizations_cache_version{0};
+
+  } // End anonymous namespace.
+
+  void template_question_localization::invalidate_cache(){
+    ++template_question_localizations_cache_version;
+  }
+  
   template_question_localization_p template_question_localization::find(const template_question_r& tq, language_t lang){
+    uint64_t version = template_question_localizations_cache_version;
+
+    if (template_question_localization_p tql = tq->find_memoized_localization(lang, version)){
+      return tql;
+    }
+    
+    ostringstream ok;
+    ok << tq->get_id() << '/' << lang;
+    string key = ok.str();
+    ::std::optional<doc_id> cached_id;
+
+    {
+      ::std::lock_guard<::std::mutex> l(template_question_localizations_cache_mutex);
+
+      if (auto f = template_question_localizations_cache.find(key); f != template_question_localizations_cache.cend() && f->second.second == version){
+	cached_id = f->second.first;
+      }
+    }
+
+    if (cached_id){
+      // The document might have been removed by referential integrity. Checking it still matches, belt and suspenders.
+      if (template_question_localization_p tql = template_question_localization::get(*tq->get_home(), *cached_id)){
+	if ((*tql)->get_template_question() == tq && (*tql)->get_language() == lang){
+	  tq->memoize_localization(lang, version, *tql);
+	  return tql;
+	}
+      }
+    }
+    
     // Check for unicity, attempt to get 2 rows.
     cursor c = cursor_on_key<template_question_localization>(tq->get_home()->get_index(config_name<"tql_q">), {.key = {tq->get_id(), lang}, .limit = 2});
     c.read_next();
@@ -976,7 +1236,21 @@ namespace interviews {
       HX2A_LOG(error) << "Found more than one template question localization for template question doc id " << tq->get_id() << " and language code " << lang << ". Retaining the first one found.";
     }
     
-    return r.front().get_doc();
+    template_question_localization_p tql = r.front().get_doc();
+    HX2A_ASSERT(tql);
+
+    {
+      ::std::lock_guard<::std::mutex> l(template_question_localizations_cache_mutex);
+
+      if (template_question_localizations_cache.size() >= template_question_localizations_cache_max_size){
+	template_question_localizations_cache.clear();
+      }
+      
+      template_question_localizations_cache[key] = {(*tql)->get_id(), version};
+    }
+
+    tq->memoize_localization(lang, version, *tql);
+    return tql;
   }
   
   void questionnaire_localization::dump(questionnaire_localization_map_per_question& m) const {
@@ -995,19 +1269,112 @@ namespace interviews {
     }
   }
   
-  void questionnaire_localization::check(){
-    // If we have already checked the localization for that version of the questionnaire, we do not need to do it again.
-    if (_questionnaire_change_count == _questionnaire->get_change_count()){
-      // Already done.
-      return;
+  namespace {
+
+    // Only there to protect against unbounded growth, there are not many questionnaire localizations.
+    constexpr size_t questionnaire_localization_indices_max_size = 1 << 12;
+
+    struct questionnaire_localization_index
+    {
+      size_t _questions_size;
+      // The question ordinal of each question localization, in the order of the list.
+      ::std::vector<size_t> _ordinals;
+    };
+
+    // By localization identifier, questionnaire change count and number of question localizations. Null when the
+    // question ordinals are not consistent, so that it is only found out and logged once.
+    ::std::mutex questionnaire_localization_indices_mutex;
+    ::std::unordered_map<string, ::std::shared_ptr<const questionnaire_localization_index>> questionnaire_localization_indices;
+
+  } // End anonymous namespace.
+
+  bool questionnaire_localization::index() const {
+    if (_indexed){
+      return !_index.empty();
     }
 
-    force_check();
-    // Noting that the check was already done for that version of the questionnaire.
-    _questionnaire_change_count = _questionnaire->get_change_count();
-  }
+    _indexed = true;
+    _index.clear();
 
-  // This function checks a number of properties of a questionnaire localization, namely:
+    // The localizations of a questionnaire which is not locked can change without the key below changing.
+    if (!is_locked()){
+      return false;
+    }
+
+    ostringstream ok;
+    ok << get_id() << '.' << _questionnaire->get_change_count() << '.' << _questions_localizations.size();
+    string key = ok.str();
+    ::std::shared_ptr<const questionnaire_localization_index> qli;
+    bool found = false;
+
+    {
+      ::std::lock_guard<::std::mutex> l(questionnaire_localization_indices_mutex);
+
+      if (auto f = questionnaire_localization_indices.find(key); f != questionnaire_localization_indices.cend()){
+	qli = f->second;
+	found = true;
+      }
+    }
+
+    if (!found){
+      // Building outside the lock.
+      auto nqli = ::std::make_shared<questionnaire_localization_index>();
+      nqli->_questions_size = _questionnaire->size();
+      ::std::vector<bool> seen(nqli->_questions_size, false);
+
+      for (const auto& ql: _questions_localizations){
+	HX2A_ASSERT(ql);
+	size_t o = ql->get_question()->get_ordinal();
+
+	if (o >= seen.size() || seen[o]){
+	  HX2A_LOG(error) << "Inconsistent question ordinals in the questionnaire of the localization " << get_id() << ", question localizations are searched.";
+	  nqli.reset();
+	  break;
+	}
+
+	seen[o] = true;
+	nqli->_ordinals.push_back(o);
+      }
+
+      qli = ::std::move(nqli);
+      ::std::lock_guard<::std::mutex> l(questionnaire_localization_indices_mutex);
+
+      if (questionnaire_localization_indices.size() >= questionnaire_localization_indices_max_size){
+	questionnaire_localization_indices.clear();
+      }
+
+      questionnaire_localization_indices.emplace(key, qli);
+    }
+
+    if (!qli){
+      return false;
+    }
+
+    _index.assign(qli->_questions_size, nullptr);
+    auto oi = qli->_ordinals.cbegin();
+
+    for (const auto& ql: _questions_localizations){
+      HX2A_ASSERT(oi != qli->_ordinals.cend());
+      _index[*oi] = ql.get();
+      ++oi;
+    }
+
+    return !_index.empty();
+  }
+  
+  void questionnaire_localization::check(){
+    // If we have already checked the localization for that version of the questionnaire, we do not need to do it again.
+    if (_questionnaire_change_count == _questionnaire->get_change_count()){
+      // Already done.
+      return;
+    }
+
+    force_check();
+    // Noting that the check was already done for that version of the questionnaire.
+    _questionnaire_change_count = _questionnaire->get_change_count();
+  }
+
+  // This function checks a number of properties of a questionnaire localization, namely:
   // - That the localization is complete, meaning that it covers the entirety of the questionnaire. No localization is
   //   missing. The process identifies questions from templates and verifies that a localization for the corresponding language
   //   exists in the template library.
@@ -1082,7 +1449,7 @@ namespace interviews {
   }
 
   // Dummy.
-  answer_data_r answer_body::make_answer_data(const answer_r&, time_t) const {
+  answer_data_r answer_body::make_answer_data(const answer_r&, time_t, const string&) const {
     HX2A_ASSERT(false);
     return make<answer_data>("", "", 0, 0, 0, nullptr);
   }
@@ -1095,16 +1462,16 @@ namespace interviews {
 
   // Specializations.
   
-answer_data_r answer_body_message::make_answer_data(const answer_r& a, time_t start_timestamp) const {
-    return make<answer_data_message>(a->get_label(), a->get_ip_address(), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation());
+answer_data_r answer_body_message::make_answer_data(const answer_r& a, time_t start_timestamp, const string& start_ip_address) const {
+    return make<answer_data_message>(a->get_label(), a->get_ip_address(start_ip_address), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation());
   }
   
   localized_answer_data_r answer_body_message::make_localized_answer_data(const string& label, const the_stack& ts, language_t lang, const question_body_r& qb, const question_localization_body_r& qlb) const {
     return make<localized_answer_data_message>(label, qlb->calculate_text(label, ts, lang, qb));
   }
 
-  answer_data_r answer_body_input::make_answer_data(const answer_r& a, time_t start_timestamp) const {
-    return make<answer_data_input>(a->get_label(), a->get_ip_address(), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment(), _input.get());
+  answer_data_r answer_body_input::make_answer_data(const answer_r& a, time_t start_timestamp, const string& start_ip_address) const {
+    return make<answer_data_input>(a->get_label(), a->get_ip_address(start_ip_address), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment(), _input.get());
   }
   
   localized_answer_data_r answer_body_input::make_localized_answer_data(const string& label, const the_stack& ts, language_t lang, const question_body_r& qb, const question_localization_body_r& qlb) const {
@@ -1112,9 +1479,9 @@ answer_data_r answer_body_message::make_answer_data(const answer_r& a, time_t st
     return make<localized_answer_data_input>(label, qlb->calculate_text(label, ts, lang, qb), qlbwc->get_comment_label(), get_comment(), _input.get());
   }
 
-  answer_data_r answer_body_select::make_answer_data(const answer_r& a, time_t start_timestamp) const {
+  answer_data_r answer_body_select::make_answer_data(const answer_r& a, time_t start_timestamp, const string& start_ip_address) const {
     HX2A_ASSERT(_choice);
-    return make<answer_data_select>(a->get_label(), a->get_ip_address(), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), make<choice_payload>(*_choice), get_comment());
+    return make<answer_data_select>(a->get_label(), a->get_ip_address(start_ip_address), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), make<choice_payload>(*_choice), get_comment());
   }
   
   localized_answer_data_r answer_body_select::make_localized_answer_data(const string& label, const the_stack& ts, language_t lang, const question_body_r& qb, const question_localization_body_r& qlb) const {
@@ -1158,8 +1525,8 @@ answer_data_r answer_body_message::make_answer_data(const answer_r& a, time_t st
     }
   }
 
-answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, time_t start_timestamp) const {
-    answer_data_multiple_choices_r apb = make<answer_data_select_at_most>(a->get_label(), a->get_ip_address(), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment());
+answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, time_t start_timestamp, const string& start_ip_address) const {
+    answer_data_multiple_choices_r apb = make<answer_data_select_at_most>(a->get_label(), a->get_ip_address(start_ip_address), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment());
     // Must now take care of the options.
     shared_add_options_to_answer_data(apb);
     return apb;
@@ -1172,8 +1539,8 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     return la;
   }
   
-  answer_data_r answer_body_select_limit::make_answer_data(const answer_r& a, time_t start_timestamp) const {
-    answer_data_multiple_choices_r apb = make<answer_data_select_limit>(a->get_label(), a->get_ip_address(), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment());
+  answer_data_r answer_body_select_limit::make_answer_data(const answer_r& a, time_t start_timestamp, const string& start_ip_address) const {
+    answer_data_multiple_choices_r apb = make<answer_data_select_limit>(a->get_label(), a->get_ip_address(start_ip_address), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment());
     // Must now take care of the options.
     shared_add_options_to_answer_data(apb);
     return apb;
@@ -1186,8 +1553,8 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     return la;
   }
   
-  answer_data_r answer_body_rank_at_most::make_answer_data(const answer_r& a, time_t start_timestamp) const {
-    rfr<answer_data_multiple_choices> apb = make<answer_data_rank_at_most>(a->get_label(), a->get_ip_address(), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment());
+  answer_data_r answer_body_rank_at_most::make_answer_data(const answer_r& a, time_t start_timestamp, const string& start_ip_address) const {
+    rfr<answer_data_multiple_choices> apb = make<answer_data_rank_at_most>(a->get_label(), a->get_ip_address(start_ip_address), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment());
     // Must now take care of the options.
     shared_add_options_to_answer_data(apb);
     return apb;
@@ -1200,8 +1567,8 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     return la;
   }
   
-  answer_data_r answer_body_rank_limit::make_answer_data(const answer_r& a, time_t start_timestamp) const {
-    answer_data_multiple_choices_r apb = make<answer_data_rank_limit>(a->get_label(), a->get_ip_address(), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment());
+  answer_data_r answer_body_rank_limit::make_answer_data(const answer_r& a, time_t start_timestamp, const string& start_ip_address) const {
+    answer_data_multiple_choices_r apb = make<answer_data_rank_limit>(a->get_label(), a->get_ip_address(start_ip_address), a->get_timestamp(start_timestamp), a->get_elapsed(), a->get_total_elapsed(), a->get_geolocation(), get_comment());
     // Must now take care of the options.
     shared_add_options_to_answer_data(apb);
     return apb;
@@ -1214,6 +1581,132 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     return la;
   }
   
+  static inline json::value make_choice_value(const choice_r& ch){
+    json::object_type o;
+    o.emplace(index_tag, json::value(static_cast<double>(ch->get_index())));
+    o.emplace(comment_tag, json::value(ch->get_comment()));
+    return json::value(::std::move(o));
+  }
+
+  // Geolocations come from a component, we do not know their members. They are small and seldom used, serializing them is
+  // acceptable.
+  static inline json::value make_geolocation_value(const rfr<geolocation>& geo){
+    json::ostream<> jo;
+    node_traits<geolocation>::payload_serialize(jo, geo.get());
+    json::value v = json::value::read<no_line_count, pretty>(jo.str());
+
+    // Removing the type tag, if any.
+    if (const json::object_type* vobj = v.if_object(); vobj && vobj->size() == 1 && vobj->cbegin()->first.size() && vobj->cbegin()->first[0] == '$'){
+      return vobj->cbegin()->second;
+    }
+
+    return v;
+  }
+  
+  json::value answer::make_answer_value(time_t start_timestamp, const string& start_ip_address) const {
+    HX2A_ASSERT(_body);
+    json::object_type o;
+    o.emplace(label_tag, json::value(get_label()));
+    o.emplace(ip_address_tag, json::value(get_ip_address(start_ip_address)));
+    o.emplace(timestamp_tag, json::value(static_cast<double>(get_timestamp(start_timestamp))));
+    o.emplace(elapsed_tag, json::value(static_cast<double>(get_elapsed())));
+    o.emplace(total_elapsed_tag, json::value(static_cast<double>(get_total_elapsed())));
+
+    if (_geolocation){
+      o.emplace(geolocation_tag, make_geolocation_value(*_geolocation));
+    }
+
+    _body->make_json_body(o);
+    return json::value(::std::move(o));
+  }
+
+  json::value answer::make_localized_answer_value(const the_stack& ts, language_t lang) const {
+    HX2A_ASSERT(_body);
+    json::object_type o;
+    question_localization_body_r qlb = get_question_localization_body();
+    const string& label = get_label();
+    o.emplace(label_tag, json::value(label));
+    o.emplace(text_tag, json::value(qlb->calculate_text(label, ts, lang, get_question()->get_body())));
+    _body->make_localized_json_body(o, qlb);
+    return json::value(::std::move(o));
+  }
+
+  void answer_body_with_comment::make_json_body(json::object_type& o) const {
+    o.emplace(comment_tag, json::value(get_comment()));
+  }
+  
+  void answer_body_with_comment::make_localized_json_body(json::object_type& o, const question_localization_body_r& qlb) const {
+    auto qlbwc = checked_cast<question_localization_body_with_comment>(qlb);
+    o.emplace(comment_label_tag, json::value(qlbwc->get_comment_label()));
+    o.emplace(comment_tag, json::value(get_comment()));
+  }
+
+  void answer_body_input::make_json_body(json::object_type& o) const {
+    answer_body_with_comment::make_json_body(o);
+    o.emplace(input_tag, json::value(_input.get()));
+  }
+  
+  void answer_body_input::make_localized_json_body(json::object_type& o, const question_localization_body_r& qlb) const {
+    answer_body_with_comment::make_localized_json_body(o, qlb);
+    o.emplace(input_tag, json::value(_input.get()));
+  }
+
+  void answer_body_with_options::make_localized_json_body(json::object_type& o, const question_localization_body_r& qlb) const {
+    answer_body_with_comment::make_localized_json_body(o, qlb);
+    auto qlbwo = checked_cast<question_localization_body_with_options>(qlb);
+    json::array_type options;
+    auto i = qlbwo->options_cbegin();
+    auto e = qlbwo->options_cend();
+    
+    while (i != e){
+      option_localization_p if_ol = *i;
+      HX2A_ASSERT(if_ol);
+      json::object_type op;
+      op.emplace(label_tag, json::value((*if_ol)->get_label()));
+      op.emplace(comment_label_tag, json::value((*if_ol)->get_comment_label()));
+      options.push_back(json::value(::std::move(op)));
+      ++i;
+    }
+
+    o.emplace(options_tag, json::value(::std::move(options)));
+  }
+
+  void answer_body_select::make_json_body(json::object_type& o) const {
+    answer_body_with_options::make_json_body(o);
+    HX2A_ASSERT(_choice);
+    o.emplace(choice_tag, make_choice_value(*_choice));
+  }
+  
+  void answer_body_select::make_localized_json_body(json::object_type& o, const question_localization_body_r& qlb) const {
+    answer_body_with_options::make_localized_json_body(o, qlb);
+    HX2A_ASSERT(_choice);
+    o.emplace(choice_tag, make_choice_value(*_choice));
+  }
+
+  void answer_body_multiple_choices::make_json_body(json::object_type& o) const {
+    answer_body_with_options::make_json_body(o);
+    json::array_type choices;
+
+    for (const auto& ch: _choices){
+      HX2A_ASSERT(ch);
+      choices.push_back(make_choice_value(*ch));
+    }
+    
+    o.emplace(choices_tag, json::value(::std::move(choices)));
+  }
+  
+  void answer_body_multiple_choices::make_localized_json_body(json::object_type& o, const question_localization_body_r& qlb) const {
+    answer_body_with_options::make_localized_json_body(o, qlb);
+    json::array_type choices;
+
+    for (const auto& ch: _choices){
+      HX2A_ASSERT(ch);
+      choices.push_back(make_choice_value(*ch));
+    }
+    
+    o.emplace(choices_tag, json::value(::std::move(choices)));
+  }
+  
   void interview::start(
 			const string& interviewee_id,
 			const string& interviewer_id,
@@ -1225,7 +1718,11 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     _start_ip_address = string{start_ip_address};
     _start_timestamp = time();
     _start_geolocation = geo;
-    _interviewee_id = interviewee_id;
+
+    if (!interviewee_id.empty()){
+      _interviewee_id = interviewee_id;
+    }
+
     _interviewer_id = interviewer_id;
     _interviewer_user = interviewer_user;
     _language = language;
@@ -1248,32 +1745,45 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
   }
 
   question_r interview::run_transitions(const the_stack& ts, const question_r& q) const {
-    return q->run_transitions(ts, _start_timestamp);
+    return q->run_transitions(ts, _start_timestamp, _start_ip_address, execution_plans::get(get_questionnaire()).get());
+  }
+
+  progress_t interview::get_progress(const question_r& q) const {
+    if (auto plan = execution_plans::get(get_questionnaire())){
+      return plan->get_progress(q->get_ordinal());
+    }
+    
+    questionnaire_localization_p if_qql = get_questionnaire_localization();
+    HX2A_ASSERT(if_qql);
+    return (*if_qql)->get_progress(q);
   }
 
   // If the campaign is over, an exception is raised.
   localizations interview::next_question_localization() const {
-    HX2A_ASSERT(_next_question);
-    HX2A_ASSERT(_next_question->supports_localization());
+    question_p if_nq = get_next_question();
+    HX2A_ASSERT(if_nq);
+    question_r nq = *if_nq;
+    HX2A_ASSERT(nq->supports_localization());
 
-    if (question_localization_p ql = find_question_localization(*_next_question)){
+    if (question_localization_p ql = find_question_localization(nq)){
       return *ql;
     }
       
-    if (question_from_template* qft = dynamic_cast<question_from_template*>(_next_question.get())){
+    if (question_from_template* qft = dynamic_cast<question_from_template*>(&nq.get())){
       return template_localization{*template_question_localization::find(qft->get_template_question(), get_language()), *qft};
     }
 
-    HX2A_LOG(error) << "Cannot find a localization for the question with label " << _next_question->get_label();
+    HX2A_LOG(error) << "Cannot find a localization for the question with label " << nq->get_label();
     throw internal_error();
   }
     
   question_r interview::calculate_new_next_question(the_stack& ts){
     HX2A_ASSERT(_state == ongoing);
-    HX2A_ASSERT(_next_question);
-    HX2A_ASSERT(_next_question->supports_localization());
+    question_p if_nq = get_next_question();
+    HX2A_ASSERT(if_nq);
+    HX2A_ASSERT((*if_nq)->supports_localization());
     // Let's run the transitions from the current next question.
-    question_r new_next_question = run_transitions(ts, *_next_question);
+    question_r new_next_question = run_transitions(ts, *if_nq);
     // Now the new next question might be a loop, so if it is not, we're fine, and if it is, we need to scan further.
     new_next_question = calculate_new_next_question(ts, new_next_question);
     set_next_question(new_next_question);
@@ -1303,7 +1813,17 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     calculate(ts);
     ts.dump();
 
+    // The stack above replays the history. From now on the JavaScript runs for the new answer only.
+    javascript_budget::enforcement jbe;
     question_r new_next_question = calculate_new_next_question(ts);
+
+    // With an open log, the interview document is only written once the log is full, or to record the completion.
+    if (!_logging || (*_log)->size() >= log_max_size || is_completed()){
+      compact();
+      // The stack now reflects the whole history, including the loop entries just added.
+      save_stack(ts);
+    }
+    
     question_localization_p if_ql = find_question_localization(new_next_question);
     questionnaire_localization_p if_qql = get_questionnaire_localization();
     HX2A_ASSERT(if_qql);
@@ -1311,12 +1831,12 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     
     if (if_ql){
       question_localization_r ql = *if_ql;
-      return ql->make_localized_question(ts, _language, get_questionnaire()->get_logo(), qql->get_title(), qql->get_progress(ql->get_question()));
+      return ql->make_localized_question(ts, _language, get_questionnaire()->get_logo(), qql->get_title(), get_progress(ql->get_question()));
     }
     
     if (question_from_template* qft = dynamic_cast<question_from_template*>(&new_next_question.get())){
       if (template_question_localization_p tql = template_question_localization::find(qft->get_template_question(), get_language())){
-	return (*tql)->make_localized_question(qft->get_label(), ts, _language, get_questionnaire()->get_logo(), qql->get_title(), *qft, qql->get_progress(*qft));
+	return (*tql)->make_localized_question(qft->get_label(), ts, _language, get_questionnaire()->get_logo(), qql->get_title(), *qft, get_progress(*qft));
       }
     }
 
@@ -1329,6 +1849,18 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     auto i = qq->questions_cbegin();
     auto e = qq->questions_cend();
     question_end_loop_p qel;
+
+    // The execution plan knows where the matching end loop is.
+    if (auto plan = execution_plans::get(qq)){
+      size_t m = plan->get_question(qbl->get_ordinal())._matching_loop;
+      HX2A_ASSERT(m != execution_plan::npos && m < qq->size());
+      ::std::advance(i, m);
+      HX2A_ASSERT(*i);
+      question_r q = **i;
+      qel = dynamic_cast<question_end_loop*>(&q.get());
+      HX2A_ASSERT(qel);
+      return qel;
+    }
     
     // Let's first find the question begin loop.
     while (i != e){
@@ -1365,12 +1897,20 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
   }
 
   // Function called when a question begin loop is encountered for the first time.
+  // Only called where loops start, replaying the history of interviews already recorded never checks the bound.
+  static void check_loop_operand_size(const the_stack& ts, const question_begin_loop_r& qbl){
+    if (ts.get_loop_operand_size() > the_stack_frame::loop_operand_max_size){
+      throw question_loop_operand_is_too_large(qbl->get_label());
+    }
+  }
+
   question_r interview::process_begin_loop(the_stack& ts, const question_begin_loop_r& qbl){
     // We need to evaluate the first loop variable value, if any (the vector might be empty), to see if there is a point running
     // the loop, or if it is necessary to jump to the matching end.
     answer_p loa = ts.process_begin_loop(_language, qbl);
     
     if (loa){
+      check_loop_operand_size(ts, qbl);
       // Recording the begin loop in the interview.
       add_begin_loop(qbl, *loa, ts.get_index());
       // Processing transitions.
@@ -1484,36 +2024,40 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 
   localized_question_r interview::next_localized_question(the_stack& ts) const {
     HX2A_ASSERT(_state != initiated);
-    HX2A_ASSERT(_next_question);
-    HX2A_ASSERT(_next_question->supports_localization());
-    question_localization_p if_ql = find_question_localization(*_next_question);
+    question_p if_nq = get_next_question();
+    HX2A_ASSERT(if_nq);
+    question_r nq = *if_nq;
+    HX2A_ASSERT(nq->supports_localization());
+    question_localization_p if_ql = find_question_localization(nq);
     questionnaire_localization_p if_qql = get_questionnaire_localization();
     HX2A_ASSERT(if_qql);
     questionnaire_localization_r qql = *if_qql;
     
     if (if_ql){
       question_localization_r ql = *if_ql;
-      return ql->make_localized_question(ts, _language, get_questionnaire()->get_logo(), qql->get_title(), qql->get_progress(ql->get_question()));
+      return ql->make_localized_question(ts, _language, get_questionnaire()->get_logo(), qql->get_title(), get_progress(ql->get_question()));
     }
     
-    if (question_from_template* qft = dynamic_cast<question_from_template*>(_next_question.get())){
+    if (question_from_template* qft = dynamic_cast<question_from_template*>(&nq.get())){
       template_question_localization_p tql = template_question_localization::find(qft->get_template_question(), get_language());
 
       if (!tql){
-	HX2A_LOG(error) << "Found a question with label \"" << _next_question->get_label() << "\", which is a template question, and its localization is missing from the template library.";
+	HX2A_LOG(error) << "Found a question with label \"" << nq->get_label() << "\", which is a template question, and its localization is missing from the template library.";
 	throw internal_error();
       }
 
-      return (*tql)->make_localized_question(qft->get_label(), ts, _language, get_questionnaire()->get_logo(), qql->get_title(), *qft, qql->get_progress(*qft));
+      return (*tql)->make_localized_question(qft->get_label(), ts, _language, get_questionnaire()->get_logo(), qql->get_title(), *qft, get_progress(*qft));
     }
 
-    HX2A_LOG(error) << "Cannot find a localization for the question with label " << _next_question->get_label();
+    HX2A_LOG(error) << "Cannot find a localization for the question with label " << nq->get_label();
     throw internal_error();
   }
 
   // Calculating the stack up to the answer index specified, that answer excluded.
   void interview::calculate(the_stack& ts, history_type::const_iterator pos) const {
     HX2A_ASSERT(!ts.size());
+    // Questionnaires compiled before ordinals existed have no plan.
+    ts.set_by_ordinal(execution_plans::get(get_questionnaire()) != nullptr);
     
     if constexpr (debug_mode){
       // We check that the index pointed at a "real" answer, not a begin or end loop.
@@ -1529,6 +2073,15 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     
     auto i = _history.cbegin();
 
+    // Starting from the closest snapshot not going past the position. Iterating is cheap compared to replaying.
+    if (stack_snapshot_p if_ss = find_stack_snapshot(::std::distance(i, pos))){
+      stack_snapshot_r ss = *if_ss;
+      size_t hs = ss->get_history_size();
+      HX2A_LOG(trace) << "Restoring the stack snapshot covering " << hs << " history entries.";
+      ts.restore(ss);
+      ::std::advance(i, hs);
+    }
+
     while (i != pos){
       HX2A_ASSERT(*i);
       entry_r e = **i;
@@ -1537,7 +2090,74 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     }
   }
 
-  static inline question_r find_next_regular_question(the_stack& ts, language_t lang, const question_r& q, time_t start_timestamp){
+  void interview::forget_stack(size_t from, size_t to){
+    auto is_stale = [&](const stack_snapshot_r& ss){
+      size_t hs = ss->get_history_size();
+      return from < hs && hs < to;
+    };
+
+    if (_stack_snapshot && is_stale(*_stack_snapshot)){
+      _stack_snapshot = stack_snapshot_p{};
+    }
+
+    auto i = _stack_checkpoints.begin();
+    auto e = _stack_checkpoints.end();
+
+    while (i != e){
+      HX2A_ASSERT(*i);
+
+      if (is_stale(**i)){
+	// woraround missing returned next iterator in erase() function.
+	stack_checkpoints_type::iterator next = i;
+	++next;
+	_stack_checkpoints.erase(i);
+	i = next;
+      }
+      else{
+	++i;
+      }
+    }
+  }
+
+  stack_snapshot_p interview::find_stack_snapshot(size_t at_most) const {
+    stack_snapshot_p rtnd;
+
+    if (_stack_snapshot && _stack_snapshot->get_history_size() <= at_most){
+      rtnd = _stack_snapshot;
+    }
+
+    // Checkpoints are in increasing history sizes.
+    for (auto i = _stack_checkpoints.crbegin(), e = _stack_checkpoints.crend(); i != e; ++i){
+      HX2A_ASSERT(*i);
+      stack_snapshot_r ss = **i;
+      size_t hs = ss->get_history_size();
+
+      if (hs <= at_most){
+	if (!rtnd || rtnd->get_history_size() < hs){
+	  rtnd = ss;
+	}
+
+	break;
+      }
+    }
+
+    return rtnd;
+  }
+
+  void interview::calculate(the_stack& ts) const {
+    calculate(ts, _history.cend());
+
+    if (_log){
+      interview_log_r l = *_log;
+
+      for (auto i = l->entries_cbegin(), e = l->entries_cend(); i != e; ++i){
+	HX2A_ASSERT(*i);
+	ts.process_entry(_language, **i);
+      }
+    }
+  }
+
+  static inline question_r find_next_regular_question(the_stack& ts, language_t lang, const question_r& q, time_t start_timestamp, const string& start_ip_address, const execution_plan* plan){
     question_r f = q;
     
     while (true){
@@ -1551,7 +2171,11 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 	{
 	  question_begin_loop* qbl = dynamic_cast<question_begin_loop*>(&f.get());
 	  HX2A_ASSERT(qbl);
-	  ts.process_begin_loop(lang, *qbl);
+
+	  if (ts.process_begin_loop(lang, *qbl)){
+	    check_loop_operand_size(ts, *qbl);
+	  }
+
 	  break;
 	}
 	
@@ -1562,10 +2186,62 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 	}
       }
 
-      f = f->run_transitions(ts, start_timestamp);
+      f = f->run_transitions(ts, start_timestamp, start_ip_address, plan);
     }
   }
 
+  // Same as entry::is_impacted_by, looking up the dependency graph of the execution plan if there is one. Begin loops are
+  // impacted by a specific answer, not by any answer to the operand question, a link comparison is all they need.
+  static inline bool is_entry_impacted_by(const execution_plan* plan, const entry_r& e, const answer_r& a){
+    if (plan && e->get_loop_type() == question::regular){
+      return plan->is_impacted(a->get_question()->get_ordinal(), e->get_question()->get_ordinal());
+    }
+
+    return e->is_impacted_by(a);
+  }
+
+  // Returns true if running the transitions of the question of a history entry again leads to the question of the next
+  // entry, as when the history was recorded. That is when the question is regular, when the next entry is one of its
+  // destinations (and not past an empty loop), and when its transitions use none of the answers changed since the
+  // history was recorded: the revised one, and the resected ones if any. Looks up the dependency graph of the execution
+  // plan if there is one. Otherwise scans the conditions, and only the revised answer can be checked.
+  static inline bool are_transitions_settled(const execution_plan* plan, const question_r& q, const entry_r& next, const question_r& revised, const question_set& resected, bool has_resected){
+    if (q->get_loop_type() != question::regular){
+      return false;
+    }
+
+    question_r nq = next->get_question();
+
+    if (plan){
+      const execution_plan::question_entry& qe = plan->get_question(q->get_ordinal());
+      const auto& ds = qe._transition_destinations;
+
+      if (::std::find(ds.cbegin(), ds.cend(), nq->get_ordinal()) == ds.cend()){
+	return false;
+      }
+
+      if (has_resected){
+	return !plan->is_driven(revised->get_ordinal(), q->get_ordinal()) && !plan->depends_on_any(q->get_ordinal(), resected);
+      }
+
+      return !plan->is_driven(revised->get_ordinal(), q->get_ordinal());
+    }
+
+    if (has_resected){
+      return false;
+    }
+
+    for (auto i = q->transitions_cbegin(), e = q->transitions_cend(); i != e; ++i){
+      HX2A_ASSERT(*i);
+
+      if ((*i)->get_destination() == nq){
+	return !q->is_driven_by(revised);
+      }
+    }
+
+    return false;
+  }
+
   // The function will return true if the entry is truly impacted.
   // Otherwise it'll return false and will update the previous and new stacks.
   // Language given for the case where a text is impacted. Never know, different languages might have different impact status.
@@ -1628,15 +2304,20 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 
     answer_r pa = ea->get_answer();
     question_r q = pa->get_question();
+    na->intern_ip_address(_start_ip_address);
     
     // We must now validate the answer and check that it is an answer to the same question as the previous one.
     if (q != na->get_question()){
       throw answer_is_incorrect();
     }
     
-    // Building the stack up to the replaced answer, but not including it.
+    ::std::shared_ptr<const execution_plan> plan = execution_plans::get(get_questionnaire());
+    // The position of the revised answer in the history.
+    size_t rpos = ::std::distance(_history.begin(), pos);
+    // Building the stack up to the replaced answer, but not including it. It starts from the closest checkpoint.
     the_stack pts;
     calculate(pts, pos);
+    forget_history_index();
     // As we are going to compare the result of calculated texts and loop operands applying the "old" stack and the new one with the replaced answer, we
     // must make a copy.
     the_stack nts(pts);
@@ -1649,15 +2330,51 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     pa->graft(na);
     auto i = ++pos;
     auto he = _history.end();
+    // The position of the current entry in the history.
+    size_t ipos = rpos + 1;
+    // Once entries are resected, the rest of the history was not recorded with the stacks we calculate.
+    bool resected = false;
+    // The questions of the answers resected, and whether loops were resected too, in which case transitions always run
+    // again.
+    question_set resected_questions;
+    bool loops_resected = false;
 
     while (true){
-      // Let's run the new transitions.
-      question_r nnetq = run_transitions(nts, q);
+      // The stacks only differ by the previous and new answers. Once the previous answer has no influence on the previous
+      // stack, the new one has none either, and both stacks are the one the rest of the history was recorded with. The
+      // rest of the history stands as is, and so does the next question. There is no need to run anything further.
+      if (!resected && !pts.holds(pa)){
+	HX2A_LOG(trace) << "Answer revision converged after " << ipos - rpos << " history entries.";
+	// The snapshots covering the converged entries are still valid.
+	forget_stack(rpos, ipos);
+
+	if (stack_snapshot_p if_ss = find_stack_snapshot(_history.size()); if_ss && if_ss->get_history_size() >= ipos){
+	  the_stack ts;
+	  calculate(ts);
+	  return next_localized_question(ts);
+	}
+
+	while (i != he){
+	  HX2A_ASSERT(*i);
+	  nts.process_entry(_language, **i);
+	  ++i;
+	}
+
+	return next_localized_question(nts);
+      }
+      
+      // Let's run the new transitions, unless they lead to the next question recorded anyway. Running them again would
+      // also draw random transitions again.
+      question_r nnetq = i != he && !loops_resected && are_transitions_settled(plan.get(), q, **i, na->get_question(), resected_questions, resected) ?
+	(**i)->get_question() : run_transitions(nts, q);
       
       // We might be at the end of the interview.
       if (i == he){
+	// The history changed from the revised answer on. The snapshots are rebuilt by the next move ahead.
+	forget_stack(rpos);
 	// We need to find the next regular question. It's either the one we have or a subsequent one.
-	set_next_question(find_next_regular_question(nts, _language, nnetq, _start_timestamp));
+	set_next_question(find_next_regular_question(nts, _language, nnetq, _start_timestamp, _start_ip_address, plan.get()));
+	regraft_stashed_answers(nts, plan.get());
 	return next_localized_question(nts);
       }
       
@@ -1672,12 +2389,18 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
       if (nnetq != pnetq){
 	// They are different. The answer change has driven to another question.
 	// That other question might already have an answer subsequently in the history. If it does, we need to resect the history.
-	resect(i, nnetq);
+	if (!resect(i, nnetq, plan.get(), resected_questions)){
+	  loops_resected = true;
+	}
+
+	resected = true;
 	
 	if (i == he){
 	  // We have removed everything, there was no answer to the question.
+	  forget_stack(rpos);
 	  // We need to find the next regular question. It's either the one we have or a subsequent one.
-	  set_next_question(find_next_regular_question(nts, _language, nnetq, _start_timestamp));
+	  set_next_question(find_next_regular_question(nts, _language, nnetq, _start_timestamp, _start_ip_address, plan.get()));
+	  regraft_stashed_answers(nts, plan.get());
 	  return next_localized_question(nts);
 	}
 
@@ -1700,7 +2423,7 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 	HX2A_ASSERT(*i);
 	nee = **i;
 
-	if (nee->is_impacted_by(pa)){
+	if (is_entry_impacted_by(plan.get(), nee, pa)){
 	  // The function will return true if the entry is truly impacted.
 	  // Otherwise it'll return false and will update the previous and new stacks.
 	  if (process_impacted_entry(pts, nts, pa, na, _language, nee)){
@@ -1709,12 +2432,15 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 	    while (i != he){
 	      history_type::iterator next = i;
 	      ++next;
+	      stash(i, plan.get());
 	      _history.erase(i);
 	      i = next;
 	    }
 	    
+	    forget_stack(rpos);
 	    // We need to find the next regular question. It's either the one we have or a subsequent one.
-	    set_next_question(find_next_regular_question(nts, _language, nnetq, _start_timestamp));
+	    set_next_question(find_next_regular_question(nts, _language, nnetq, _start_timestamp, _start_ip_address, plan.get()));
+	    regraft_stashed_answers(nts, plan.get());
 	    return next_localized_question(nts);
 	  }
 	  else{
@@ -1723,6 +2449,7 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 	    nts.process_entry(_language, nee);
 	    q = nnetq;
 	    ++i;
+	    ++ipos;
 	    continue;
 	  }
 	}
@@ -1732,6 +2459,7 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 	  nts.process_entry(_language, nee);
 	  q = nnetq;
 	  ++i;
+	  ++ipos;
 	  continue;
 	}
       }
@@ -1740,7 +2468,7 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
       // It might be impacted if it is a begin loop or if it contains a calculated text.
       // If not impacted, we need to add the entry to both stacks and keep going.
       
-      if (nee->is_impacted_by(pa)){
+      if (is_entry_impacted_by(plan.get(), nee, pa)){
 	// The function will return true if the entry is truly impacted.
 	// Otherwise it'll return false and will update the previous and new stacks.
 	if (process_impacted_entry(pts, nts, pa, na, _language, nee)){
@@ -1749,12 +2477,15 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 	  while (i != he){
 	    history_type::iterator next = i;
 	    ++next;
+	    stash(i, plan.get());
 	    _history.erase(i);
 	    i = next;
 	  }
 	    
+	  forget_stack(rpos);
 	  // We need to find the next regular question. It's either the one we have or a subsequent one.
-	  set_next_question(find_next_regular_question(nts, _language, nnetq, _start_timestamp));
+	  set_next_question(find_next_regular_question(nts, _language, nnetq, _start_timestamp, _start_ip_address, plan.get()));
+	  regraft_stashed_answers(nts, plan.get());
 	  return next_localized_question(nts);
 	}
 	else{
@@ -1763,6 +2494,7 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
 	  nts.process_entry(_language, nee);
 	  q = nnetq;
 	  ++i;
+	  ++ipos;
 	  continue;
 	}
       }
@@ -1772,102 +2504,361 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
       nts.process_entry(_language, nee);
       q = nnetq;
       ++i;
+      ++ipos;
     } // End while (true).
   }
 
-  // Returns the "true" answer with an index in the history which precedes the index given. Every answer has a distinct index, from 0 to the size
-  // of the history minus 1. An index can correspond to a begin or end loop in the history.
-  localized_answer_data_and_more_payload_p interview::get_previous_answer(size_t index){
-    if (!index){
-      // Requesting the last answer.
-      // We must skip the begin and end loops until we find a "real" answer.
-      size_t idx = _history.size() - 1;
-      history_type::const_reverse_iterator i = _history.crbegin();
-      history_type::const_reverse_iterator e = _history.crend();
+  void interview::index_history(){
+    if (_history_indexed){
+      HX2A_ASSERT(_history_index.size() == _history.size());
+      HX2A_ASSERT(_log_index.size() == (_log ? (*_log)->size() : 0));
+      return;
+    }
 
-      while (i != e){
-	HX2A_ASSERT(*i);
-	entry_r e = **i;
+    _history_index.clear();
+    _log_index.clear();
+    _answers_positions.clear();
+    _history_index.reserve(_history.size());
+      
+    for (auto i = _history.begin(), e = _history.end(); i != e; ++i){
+      HX2A_ASSERT(*i);
+	
+      if ((*i)->get_loop_type() == question::regular){
+	_answers_positions.push_back(_history_index.size());
+      }
 
-	if (e->get_loop_type() == question::regular){
-	  the_stack ts;
-	  // We have a reverse iterator, we convert it into a regular non-reverse iterator.
-	  // We use a non STL-blessed ctor, we like it better that way.
-	  history_type::const_iterator ci(i);
-	  calculate(ts, ci);
-	  ts.dump();
-    
-	  entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
-	  HX2A_ASSERT(ea);
-	  return make<localized_answer_data_and_more_payload>(ea->get_answer()->make_localized_answer_data(ts, _language), idx, idx != 0);
+      _history_index.push_back(i);
+    }
+
+    if (_log){
+      interview_log_r l = *_log;
+      _log_index.reserve(l->size());
+
+      for (auto i = l->entries_cbegin(), e = l->entries_cend(); i != e; ++i){
+	HX2A_ASSERT(*i);
+	
+	if ((*i)->get_loop_type() == question::regular){
+	  _answers_positions.push_back(_history_index.size() + _log_index.size());
 	}
 
-	--idx;
-	++i;
+	_log_index.push_back(i);
       }
+    }
 
-      return {};
+    _history_indexed = true;
+  }
+
+  void interview::index_last_entry(bool is_answer){
+    if (!_history_indexed){
+      return;
     }
 
-    --index;
-    // The call below updates the index to the first one found from the latest answers, which corresponds to a "real" answer and not a begin or end
-    // loop.
-    // It looks for the answer with an index inferior or equal to the index given.
-    history_type::const_iterator i = find_answer_at_most(index);
-    
+    if (is_answer){
+      _answers_positions.push_back(entries_size());
+    }
+
+    if (_logging){
+      _log_index.push_back(::std::prev((*_log)->entries_cend()));
+      return;
+    }
+
+    // Requests appending to the history compact the interview first.
+    HX2A_ASSERT(_log_index.empty());
+    _history_index.push_back(::std::prev(_history.end()));
+  }
+
+  localized_answer_data_and_more_payload_r interview::make_answer_and_more(size_t position, bool more){
+    HX2A_ASSERT(position < entries_size());
+    size_t hs = _history_index.size();
     the_stack ts;
-    calculate(ts, i);
+    entry_p e;
+
+    if (position < hs){
+      history_type::const_iterator i = _history_index[position];
+      calculate(ts, i);
+      e = *i;
+    }
+    else{
+      // The log entries are few, they are processed on top of the whole history.
+      calculate(ts, _history.cend());
+      size_t lp = position - hs;
+
+      for (size_t n = 0; n != lp; ++n){
+	HX2A_ASSERT(*_log_index[n]);
+	ts.process_entry(_language, **_log_index[n]);
+      }
+
+      e = *_log_index[lp];
+    }
+
     ts.dump();
-    
-    HX2A_ASSERT(*i);
-    entry_r e = **i;
-    HX2A_ASSERT(e->get_loop_type() == question::regular);
-    entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
+    HX2A_ASSERT(e);
+    entry_answer* ea = dynamic_cast<entry_answer*>(e.get());
     HX2A_ASSERT(ea);
-    return make<localized_answer_data_and_more_payload>(ea->get_answer()->make_localized_answer_data(ts, _language), index, i != _history.cbegin());
+    return make<localized_answer_data_and_more_payload>(ea->get_answer()->make_localized_answer_data(ts, _language), position, more);
+  }
+
+  // Returns the "true" answer with an index which precedes the index given. Every entry has a distinct index, from 0 to
+  // the number of entries minus 1. An index can correspond to a begin or end loop.
+  localized_answer_data_and_more_payload_p interview::get_previous_answer(size_t index){
+    if (!index){
+      // Requesting the last answer.
+      // We must skip the begin and end loops until we find a "real" answer.
+      size_t as = answers_size();
+
+      if (!as){
+	return {};
+      }
+
+      size_t idx = get_answer_position(as - 1);
+      return make_answer_and_more(idx, idx != 0);
+    }
+
+    // Looking for the answer with an index inferior or equal to the index given.
+    size_t idx = find_answer_at_most(index - 1);
+    return make_answer_and_more(idx, idx != 0);
   }
 
   localized_answer_data_and_more_payload_p interview::get_next_answer(size_t index){
-    ++index;
-    history_type::const_iterator i = find_answer_at_least(index);
-    
-    the_stack ts;
-    calculate(ts, i);
-    ts.dump();
-    
-    HX2A_ASSERT(*i);
-    entry_r e = **i;
-    HX2A_ASSERT(e->get_loop_type() == question::regular);
-    entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
-    HX2A_ASSERT(ea);
-    // Advancing the iterator to check if there is more.
-    ++i;
-    return make<localized_answer_data_and_more_payload>(ea->get_answer()->make_localized_answer_data(ts, _language), index, i != _history.cend());
+    size_t idx = find_answer_at_least(index + 1);
+    return make_answer_and_more(idx, idx + 1 != entries_size());
   }
 
   // Resect is used when revising an answer. Because we do not want to ask the respondent to answer
   // unnecessarily questions they already answered, we rerun the transitions (which might contain non
   // repeatable - e.g., random - transitions), and retain everything already answered.
-  // Answers which are not used any longer are simply dropped. We could improve the algorithm and put
-  // answers not useful any longer is some stash, in case subsequent answer revisions use them. We stay
-  // simple for now and do not go that far.
-  void interview::resect(history_type::iterator& pos, const question_r& q){
+  // Answers which are not used any longer are put in a stash, in case subsequent answer revisions use them.
+  bool interview::resect(history_type::iterator& pos, const question_r& q, const execution_plan* plan, question_set& resected){
     auto e = _history.end();
+    bool rtnd = true;
 
     while (pos != e){
       HX2A_ASSERT(*pos);
       entry_r e = **pos;
 
       if (e->get_question() == q){
-	return;
+	return rtnd;
+      }
+
+      if (e->get_loop_type() == question::regular){
+	resected.insert(e->get_question()->get_ordinal());
+      }
+      else{
+	rtnd = false;
       }
 
       // woraround missing returned next iterator in erase() function.
       history_type::iterator next = pos;
       ++next;
+      stash(pos, plan);
       _history.erase(pos);
       pos = next;
     }
+
+    return rtnd;
+  }
+
+  void interview::stash(history_type::iterator pos, const execution_plan* plan){
+    if (!plan){
+      return;
+    }
+    
+    HX2A_ASSERT(*pos);
+    entry_r e = **pos;
+    entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
+
+    if (!ea){
+      return;
+    }
+
+    question_r q = ea->get_question();
+
+    if (!plan->is_context_free(q->get_ordinal())){
+      return;
+    }
+
+    // Only the most recent answer to a question is kept.
+    for (auto i = _stash.begin(), se = _stash.end(); i != se; ++i){
+      HX2A_ASSERT(*i);
+
+      if ((*i)->get_question() == q){
+	_stash.erase(i);
+	break;
+      }
+    }
+
+    if (_stash.size() == stash_max_size){
+      _stash.erase(_stash.begin());
+    }
+
+    HX2A_LOG(trace) << "Stashing the answer to question " << q->get_label() << '.';
+    // Leaving an empty entry in the history for the caller to erase. The answer is moved along with its entry, it is
+    // not erased.
+    e->graft(make<entry>());
+    _stash.push_back(e);
+  }
+
+  void interview::regraft_stashed_answers(the_stack& ts, const execution_plan* plan){
+    if (!plan){
+      return;
+    }
+    
+    while (!_stash.empty()){
+      HX2A_ASSERT(_next_question);
+      question_r nq = *_next_question;
+
+      // Never moving past a final question.
+      if (!plan->is_context_free(nq->get_ordinal()) || !nq->transitions_size()){
+	return;
+      }
+
+      auto i = _stash.begin();
+      auto se = _stash.end();
+
+      while (i != se && (*i)->get_question() != nq){
+	++i;
+      }
+
+      if (i == se){
+	return;
+      }
+
+      HX2A_ASSERT(*i);
+      entry_r e = **i;
+      HX2A_LOG(trace) << "Recording again the stashed answer to question " << nq->get_label() << '.';
+      entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
+      HX2A_ASSERT(ea);
+      answer_r a = ea->get_answer();
+      // Timed after the last answer in the history, before being appended to it.
+      pair<time_t, time_t> el = calculate_elapsed_times();
+      a->set_elapsed_times(el.first, el.second);
+      // Same as when stashing, the answer is moved along with its entry.
+      e->graft(make<entry>());
+      _stash.erase(i);
+      _history.push_back(e);
+      index_last_entry(true);
+      ts.replace_answer(a);
+      calculate_new_next_question(ts);
+    }
+  }
+
+  // Returns the answer held by the last answer entry in the range, if any.
+  template <typename Iterator>
+  static answer_p find_last_answer(Iterator i, Iterator e){
+    while (i != e){
+      HX2A_ASSERT(*i);
+      entry_r en = **i;
+
+      if (en->get_loop_type() == question::regular){
+	entry_answer* ea = dynamic_cast<entry_answer*>(&en.get());
+	HX2A_ASSERT(ea);
+	return ea->get_answer();
+      }
+	
+      ++i;
+    }
+
+    return {};
+  }
+  
+  answer_p interview::last_answer() const {
+    if (_log){
+      interview_log_r l = *_log;
+
+      if (answer_p a = find_last_answer(l->entries_crbegin(), l->entries_crend())){
+	return a;
+      }
+    }
+
+    answer_p rtnd = find_last_answer(_history.crbegin(), _history.crend());
+    // The first entry is necessarily a real answer.
+    HX2A_ASSERT(rtnd || _history.empty());
+    return rtnd;
+  }
+
+  void interview::add_entry(const entry_r& e, bool is_answer){
+    if (_logging){
+      (*_log)->push_entry_back(e);
+    }
+    else{
+      _history.push_back(e);
+    }
+    
+    index_last_entry(is_answer);
+  }
+
+  void interview::set_next_question(const question_r& q){
+    if (q->is_final()){
+      _state = completed;
+    }
+
+    if (_logging){
+      (*_log)->set_next_question(q);
+      return;
+    }
+      
+    _next_question = q;
+  }
+
+  question_p interview::get_next_question() const {
+    if (_log){
+      if (question_p nq = (*_log)->get_next_question()){
+	return nq;
+      }
+    }
+
+    return _next_question;
+  }
+
+  void interview::open_log(){
+    if (!_log){
+      // Writing the interview document this once.
+      _log = make<interview_log>(*get_home(), *this);
+    }
+
+    _logging = true;
+  }
+
+  void interview::compact(){
+    if (!_log){
+      return;
+    }
+
+    interview_log_r l = *_log;
+
+    if (l->empty() && !l->get_next_question()){
+      return;
+    }
+
+    HX2A_LOG(trace) << "Compacting " << l->size() << " log entries into the interview history.";
+
+    // The entries keep their positions, only their iterators change.
+    _log_index.clear();
+
+    while (!l->empty()){
+      entry_r e = l->pop_entry_front();
+      _history.push_back(e);
+
+      if (_history_indexed){
+	_history_index.push_back(::std::prev(_history.end()));
+      }
+    }
+
+    if (question_p nq = l->get_next_question()){
+      _next_question = nq;
+      l->set_next_question({});
+    }
+  }
+
+  entry_r interview_log::pop_entry_front(){
+    HX2A_ASSERT(!_entries.empty());
+    auto i = _entries.begin();
+    HX2A_ASSERT(*i);
+    entry_r e = **i;
+    // The entry is moved with what it holds, its answer is not erased. See interview::stash.
+    e->graft(make<entry>());
+    _entries.erase(i);
+    return e;
   }
 
   // Gives the elapsed time since the last answer recorded in the interview, and the total elapsed time since beginning of the interview.
@@ -1878,12 +2869,12 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
     time_t total_elapsed = now - _start_timestamp;
     time_t elapsed;
 
-    if (_history.empty()){
+    answer_p if_a = last_answer();
+
+    if (!if_a){
       elapsed = total_elapsed;
     }
     else{
-      answer_p if_a = last_answer();
-      HX2A_ASSERT(if_a);
       answer_r a = *if_a;
       HX2A_ASSERT(now >= a->get_timestamp(_start_timestamp));
       elapsed = now - a->get_timestamp(_start_timestamp);
@@ -1904,10 +2895,20 @@ answer_data_r answer_body_select_at_most::make_answer_data(const answer_r& a, ti
   }
   
   bool initialize(){
-    [[maybe_unused]] static bool called = initialize_body();
+    [[maybe_unused]] static thread_local bool called = initialize_body();
     return true;
   }
 
+  javascript_budget::status_t javascript_budget::check(clock::time_point start){
+    clock::duration elapsed = clock::now() - start;
+
+    if (elapsed > budget){
+      return exceeded;
+    }
+
+    return elapsed > budget / 2 ? close : within;
+  }
+
   // Methodology to add a new question type
   //
   // All virtuals to be defined on each type.
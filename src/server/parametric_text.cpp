@@ -0,0 +1,172 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#include <cctype>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+#include "interviews/parametric_text.hpp"
+
+namespace interviews {
+
+  void parametric_text::push_literal(string_view s){
+    if (s.empty()){
+      return;
+    }
+
+    _literals_size += s.size();
+
+    // Merging consecutive literals.
+    if (!_segments.empty() && _segments.back()._kind == segment::literal){
+      _segments.back()._value.append(s);
+      return;
+    }
+
+    _segments.push_back({segment::literal, string(s), 0});
+  }
+
+  parametric_text parametric_text::parse(string_view text){
+    parametric_text rtnd;
+    size_t n = text.size();
+    size_t i = 0;
+
+    while (i != n){
+      // Let's take all the characters up to the next prefix at once.
+      size_t p = text.find(eval_prefix, i);
+
+      if (p == string_view::npos){
+	rtnd.push_literal(text.substr(i));
+	break;
+      }
+
+      rtnd.push_literal(text.substr(i, p - i));
+      i = p + 1;
+
+      if (i == n){
+	rtnd.push_literal(text.substr(p, 1));
+	break;
+      }
+
+      if (text[i] != eval_open){
+	// The prefix escapes the character following it.
+	rtnd.push_literal(text.substr(i, 1));
+	++i;
+	continue;
+      }
+
+      ++i;
+
+      if (i == n){
+	rtnd.push_literal(text.substr(i - 1, 1));
+	break;
+      }
+
+      if (isdigit(static_cast<unsigned char>(text[i]))){
+	size_t funcn = 0;
+
+	do {
+	  size_t d = text[i] - '0';
+
+	  // Saturating rather than wrapping, so that an overflow cannot designate an existing function.
+	  if (funcn > (::std::numeric_limits<size_t>::max() - d) / 10){
+	    funcn = ::std::numeric_limits<size_t>::max();
+	  }
+	  else{
+	    funcn = funcn * 10 + d;
+	  }
+
+	  ++i;
+	} while (i != n && isdigit(static_cast<unsigned char>(text[i])));
+
+	if (i != n && text[i] == eval_close){
+	  rtnd._segments.push_back({segment::function_call, {}, funcn});
+	  ++i;
+	}
+	else{
+	  // Not a function call, keeping it as is.
+	  rtnd.push_literal(text.substr(p, i - p));
+	}
+
+	continue;
+      }
+
+      // It seems we're starting a loop variable access.
+      size_t c = text.find(eval_close, i);
+
+      if (c == string_view::npos){
+	rtnd.push_literal(text.substr(p));
+	break;
+      }
+
+      rtnd._segments.push_back({segment::loop_variable, string(text.substr(i, c - i)), 0});
+      i = c + 1;
+    }
+
+    return rtnd;
+  }
+
+  bool parametric_text::calls_function_beyond(size_t fn) const {
+    for (const auto& s: _segments){
+      if (s._kind == segment::function_call && s._function >= fn){
+	return true;
+      }
+    }
+
+    return false;
+  }
+
+  namespace {
+
+    // Texts belong to localizations, their number is limited. The bound is only there to protect against texts
+    // being edited indefinitely.
+    constexpr size_t parametric_texts_max_size = 1 << 16;
+
+    ::std::mutex parametric_texts_mutex;
+    ::std::unordered_map<string, ::std::shared_ptr<const parametric_text>> parametric_texts_map;
+
+    // The texts the thread already looked up, in front of the registry, so that rendering takes no lock. Bounded the
+    // same way.
+    thread_local ::std::unordered_map<string, ::std::shared_ptr<const parametric_text>> thread_parametric_texts;
+
+  } // End anonymous namespace.
+
+  ::std::shared_ptr<const parametric_text> parametric_texts::get(const string& text){
+    if (auto f = thread_parametric_texts.find(text); f != thread_parametric_texts.cend()){
+      return f->second;
+    }
+
+    ::std::shared_ptr<const parametric_text> pt;
+
+    {
+      ::std::lock_guard<::std::mutex> l(parametric_texts_mutex);
+
+      if (auto f = parametric_texts_map.find(text); f != parametric_texts_map.cend()){
+	pt = f->second;
+      }
+    }
+
+    if (!pt){
+      // Parsing outside the lock.
+      pt = ::std::make_shared<const parametric_text>(parametric_text::parse(text));
+      ::std::lock_guard<::std::mutex> l(parametric_texts_mutex);
+
+      if (parametric_texts_map.size() >= parametric_texts_max_size){
+	// Texts in use are kept alive by their shared pointers.
+	parametric_texts_map.clear();
+      }
+
+      pt = parametric_texts_map.emplace(text, ::std::move(pt)).first->second;
+    }
+
+    if (thread_parametric_texts.size() >= parametric_texts_max_size){
+      thread_parametric_texts.clear();
+    }
+
+    thread_parametric_texts.emplace(text, pt);
+    return pt;
+  }
+
+} // End namespace interviews.
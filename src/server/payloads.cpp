@@ -10,7 +10,10 @@
 
 #include "hx2a/checked_cast.hpp"
 
+#include "interviews/conditions.hpp"
 #include "interviews/exception.hpp"
+#include "interviews/loop_operand.hpp"
+#include "interviews/parametric_text.hpp"
 #include "interviews/payloads.hpp"
 
 namespace interviews {
@@ -55,61 +58,16 @@ namespace interviews {
   }
 
   // Checks that if functions are used, their index does not reach fn or more.
-  // Searches for pattersn like @{n} where n should be between 0 and fn - 1.
+  // Searches for patterns like @{n} where n should be between 0 and fn - 1.
   // It does not validate loop variable names. They are validated at runtime.
+  // Parsing the text also registers it, so that it does not have to be parsed at the first rendering.
   static inline void validate_parametric_text(const string& label, const string& text, size_t fn){
-    auto i = text.cbegin();
-    auto e = text.cend();
-
-    while (i != e){
-      if (*i == eval_prefix){
-	++i;
-
-	if (i == e){
-	  return;
-	}
-
-	if (*i == eval_open){
-	  // Read @{, need to accumulate the function number.
-	  ++i;
-
-	  if (i == e){
-	    return;
-	  }
-
-	  char c = *i;
-
-	  if (isdigit(c)){
-	    uint64_t funcn = c - '0';
-	    
-	    do {
-	      ++i;
-	      
-	      if (i == e){
-		return;
-	      }
-	      
-	      c = *i;
-
-	      if (!isdigit(c)){
-		break;
-	      }
-	      
-	      // We let funny things happen in case of overflow. We do not check.
-	      funcn += funcn * 10 + c - '0';
-	    } while (true);
-
-	    if (c == eval_close){
-	      if (funcn >= fn){
-		throw function_call_out_of_bounds(label);
-	      }
-	    }
-	  } // End if (isdigit(c)).
-	  // If it's not a digit, we don't care, we don't validate loop variable names.
-	}
-      }
-      
-      ++i;
+    if (parametric_text::is_literal(text)){
+      return;
+    }
+    
+    if (parametric_texts::get(text)->calls_function_beyond(fn)){
+      throw function_call_out_of_bounds(label);
     }
   }
   
@@ -503,6 +461,12 @@ namespace interviews {
     HX2A_ASSERT(f->second.second);
     // It'll check that the operand and the variable are not empty.
     question_r q = make<question_begin_loop>(_label, *f->second.second, _variable, _operand);
+
+    // Parsing the operand once, so that runs find it registered.
+    if (auto p = loop_operand_paths::get(_operand); p && p->get_root() == _question.get()){
+      HX2A_LOG(trace) << "Loop operand of question " << _label << " is a path, it will be applied natively.";
+    }
+
     // We must push the question in the questionnaire so that referential integrity is happy that the localization bears
     // a link to it.
     qq->push_question_back(q);
@@ -766,6 +730,13 @@ namespace interviews {
       catch(...){
 	throw source_question_transition_condition_is_incorrect(_label, t->_destination);
       }
+
+      // Classifying the condition. Simple conditions are evaluated natively, without V8. Parameters are given with
+      // duplicates, it does not prevent the classification.
+      if (!ocode.empty()){
+	::std::vector<string> labels(t->_parameters.cbegin(), t->_parameters.cend());
+	HX2A_LOG(trace) << "Transition from question " << _label << " to question " << t->_destination << " is evaluated " << (expression::compile(ocode, labels) ? "natively." : "by V8.");
+      }
       
       ++i;
     }
@@ -1079,6 +1050,59 @@ namespace interviews {
     return make<answer>(tql, qft, ip_address, elapsed, total_elapsed, _geo_location, compile(tql->get_template_question()->get_body(), tql->get_body()));
   }
   
+  questionnaire_transitions_report::questionnaire_transitions_report(const questionnaire_r& qq):
+    _transitions(*this)
+  {
+    // Counters are only available for locked questionnaires, the others do not use compiled conditions.
+    string qqk = qq->get_version_key();
+    auto i = qq->questions_cbegin();
+    auto e = qq->questions_cend();
+
+    while (i != e){
+      HX2A_ASSERT(*i);
+      question_r q = **i;
+      auto ti = q->transitions_cbegin();
+      auto te = q->transitions_cend();
+      size_t n = 0;
+
+      while (ti != te){
+	HX2A_ASSERT(*ti);
+	transition_r t = **ti;
+	string_view code = t->get_condition_code();
+	const char* path = transition_report::unconditional;
+	uint64_t native_runs = 0;
+	uint64_t v8_runs = 0;
+	uint64_t slow_runs = 0;
+
+	if (!code.empty()){
+	  ::std::vector<string> labels;
+	  auto pi = t->parameters_cbegin();
+	  auto pe = t->parameters_cend();
+
+	  while (pi != pe){
+	    HX2A_ASSERT(*pi);
+	    labels.push_back((*pi)->get_label());
+	    ++pi;
+	  }
+
+	  path = expression::compile(code, labels) ? transition_report::native : transition_report::v8;
+
+	  if (const compiled_condition* cc = compiled_conditions::find(transition::make_key(qqk, q->get_label(), n))){
+	    native_runs = cc->get_native_runs();
+	    v8_runs = cc->get_v8_runs();
+	    slow_runs = cc->get_slow_runs();
+	  }
+	}
+
+	_transitions.push_back(make<transition_report>(q->get_label(), t->get_destination()->get_label(), path, native_runs, v8_runs, slow_runs));
+	++n;
+	++ti;
+      }
+
+      ++i;
+    }
+  }
+  
   interview_data::interview_data(const interview_r& i):
     _start_ip_address(*this, i->get_start_ip_address()),
     _start_timestamp(*this, i->get_start_timestamp()),
@@ -1106,11 +1130,25 @@ namespace interviews {
 
       // We do not include (yet) the begin and end loops.
       if (ea){
-	_answers.push_back(ea->get_answer()->make_answer_data(_start_timestamp));
+	_answers.push_back(ea->get_answer()->make_answer_data(_start_timestamp, _start_ip_address));
       }
       
       ++hi;
     }
+
+    // Interviews are listed without being compacted.
+    if (interview_log_p if_l = i->get_log()){
+      interview_log_r l = *if_l;
+
+      for (auto li = l->entries_cbegin(), le = l->entries_cend(); li != le; ++li){
+	HX2A_ASSERT(*li);
+	entry_r e = **li;
+
+	if (entry_answer* ea = dynamic_cast<entry_answer*>(&e.get())){
+	  _answers.push_back(ea->get_answer()->make_answer_data(_start_timestamp, _start_ip_address));
+	}
+      }
+    }
     
     geolocation_p geo = i->get_start_geolocation();
 
@@ -1120,9 +1158,9 @@ namespace interviews {
     }
   }
 
-  answer_data::answer_data(const answer_r& an, time_t start_timestamp):
+  answer_data::answer_data(const answer_r& an, time_t start_timestamp, const string& start_ip_address):
     _label(*this, an->get_label()),
-    _ip_address(*this, an->get_ip_address()),
+    _ip_address(*this, an->get_ip_address(start_ip_address)),
     _timestamp(*this, an->get_timestamp(start_timestamp)),
     _elapsed(*this, an->get_elapsed()),
     _total_elapsed(*this, an->get_total_elapsed()),
@@ -1154,26 +1192,137 @@ namespace interviews {
     the_stack ts;
     i->calculate(ts);
     ts.dump();
-    
-    auto hi = i->history_cbegin();
-    auto he = i->history_cend();
 
-    while (hi != he){
-      HX2A_ASSERT(*hi);
-      entry_r e = **hi;
+    // Interviews are read without being compacted.
+    i->for_each_entry([&](const entry_r& e){
       entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
 
       // We do not include (yet) the begin and end loops.
       if (ea){
 	_answers.push_back(ea->get_answer()->make_localized_answer_data(ts, i->get_language()));
       }
-      
-      ++hi;
-    }
+    });
   }
   
+  campaign_statistics_data::campaign_statistics_data(const statistics_delta& d):
+    _initiated(*this, d.get_state(interview::initiated)),
+    _ongoing(*this, d.get_state(interview::ongoing)),
+    _completed(*this, d.get_state(interview::completed)),
+    _completion_rate(*this, 0),
+    _questions(*this)
+  {
+    if (int64_t started = _ongoing.get() + _completed.get(); started > 0){
+      _completion_rate = ((float)_completed.get() / (float)started) * 100.0;
+    }
+
+    for (const auto& [label, qc]: d.get_questions()){
+      question_statistics_data_r qsd = make<question_statistics_data>(label, qc._answers, qc._pending);
+
+      for (const auto& [index, oc]: qc._options){
+	option_statistics_data_r osd = make<option_statistics_data>(index, oc._count);
+
+	for (const auto& [position, n]: oc._ranks){
+	  osd->_ranks.push_back(make<rank_statistics_data>(position, n));
+	}
+
+	qsd->_options.push_back(osd);
+      }
+
+      _questions.push_back(qsd);
+    }
+  }
+
+  export_columns::export_columns(const questionnaire_r& qq):
+    _columns(*this)
+  {
+    size_t position = 0;
+
+    for (auto i = qq->questions_cbegin(), e = qq->questions_cend(); i != e; ++i){
+      HX2A_ASSERT(*i);
+      question_r q = **i;
+
+      // Loop boundaries receive no answers.
+      if (q->get_loop_type() == question::regular){
+	_columns.push_back(make<export_column>(position, q->get_label()));
+      }
+
+      ++position;
+    }
+  }
+
+  export_row::export_row(const interview_r& i):
+    _interview_id(*this, i->get_id()),
+    _interviewee_id(*this, i->get_interviewee_id()),
+    _start_timestamp(*this, i->get_start_timestamp()),
+    _state(*this, i->get_state()),
+    _cells(*this)
+  {
+    ::std::unordered_map<string, export_cell_p> cells;
+    time_t start_timestamp = i->get_start_timestamp();
+    const string& start_ip_address = i->get_start_ip_address();
+
+    auto add = [&](const entry_r& e){
+      entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
+
+      if (!ea){
+	return;
+      }
+
+      answer_r a = ea->get_answer();
+      string label = a->get_label();
+      export_cell_p& c = cells[label];
+
+      if (!c){
+	c = make<export_cell>(label);
+	_cells.push_back(*c);
+      }
+
+      (*c)->_answers.push_back(a->make_answer_data(start_timestamp, start_ip_address));
+    };
+
+    for (auto hi = i->history_cbegin(), he = i->history_cend(); hi != he; ++hi){
+      HX2A_ASSERT(*hi);
+      add(**hi);
+    }
+
+    // Interviews are exported without being compacted.
+    if (interview_log_p if_l = i->get_log()){
+      interview_log_r l = *if_l;
+
+      for (auto li = l->entries_cbegin(), le = l->entries_cend(); li != le; ++li){
+	HX2A_ASSERT(*li);
+	add(**li);
+      }
+    }
+  }
+
+  questionnaire_localization_map_per_question localized_interview_data::make_localization_map(const interview_r& i, language_t lang){
+    questionnaire_localization_map_per_question m;
+
+    if (i->get_language() == lang){
+      return m;
+    }
+
+    questionnaire_localization_p if_qql = i->get_questionnaire_localization();
+    HX2A_ASSERT(if_qql);
+    questionnaire_localization_r qql = *if_qql;
+
+    // So it's really a different language. Must look for a localization, if any.
+    questionnaire_localization_r ql = questionnaire_localization::find(qql->get_questionnaire(), lang).or_throw<questionnaire_localization_does_not_exist>();
+    
+    // Found it! Checking it. No worries the check returns immediately if already done.
+    ql->check();
+    ql->dump(m);
+    return m;
+  }
+
   // Possibly in another language the interview was taken in.
   localized_interview_data::localized_interview_data(const interview_r& i, language_t lang):
+    localized_interview_data(i, lang, make_localization_map(i, lang))
+  {
+  }
+
+  localized_interview_data::localized_interview_data(const interview_r& i, language_t lang, const questionnaire_localization_map_per_question& m):
     _interviewee_id(*this, i->get_interviewee_id()),
     _interviewer_id(*this, i->get_interviewer_id()),
     _interviewer_user(*this),
@@ -1191,43 +1340,21 @@ namespace interviews {
     i->calculate(ts);
     ts.dump();
     
-    auto hi = i->history_cbegin();
-    auto he = i->history_cend();
-    
+    // Interviews are read without being compacted.
     if (i->get_language() == lang){
-      while (hi != he){
-	HX2A_ASSERT(*hi);
-	entry_r e = **hi;
-
+      i->for_each_entry([&](const entry_r& e){
 	if (entry_answer* ea = dynamic_cast<entry_answer*>(&e.get())){
 	  // We do not include (yet) the begin and end loops.
 	  _answers.push_back(ea->get_answer()->make_localized_answer_data(ts, lang));
 	}
-	
-	++hi;
-      }
+      });
 
       return;
     }
 
-    questionnaire_localization_p if_qql = i->get_questionnaire_localization();
-    HX2A_ASSERT(if_qql);
-    questionnaire_localization_r qql = *if_qql;
-
-    // So it's really a different language. Must look for a localization, if any.
-    questionnaire_localization_r ql = questionnaire_localization::find(qql->get_questionnaire(), lang).or_throw<questionnaire_localization_does_not_exist>();
-    
-    // Found it! Checking it. No worries the check returns immediately if already done.
-    ql->check();
-
-    questionnaire_localization_map_per_question m;
-    ql->dump(m);
     auto me = m.cend();
     
-    while (hi != he){
-      HX2A_ASSERT(*hi);
-
-      entry_r e = **hi;
+    i->for_each_entry([&](const entry_r& e){
       entry_answer* ea = dynamic_cast<entry_answer*>(&e.get());
       
       // We do not include (yet) the begin and end loops.
@@ -1248,9 +1375,7 @@ namespace interviews {
 	
 	_answers.push_back(a->make_localized_answer_data(ts, lang, *loc));
       }
-      
-      ++hi;
-    }
+    });
   }
 
 } // End namespace interviews.
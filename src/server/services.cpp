@@ -58,6 +58,7 @@
 
 #include "interviews/ontology.hpp"
 #include "interviews/payloads.hpp"
+#include "interviews/statistics.hpp"
 
 namespace interviews {
 
@@ -399,6 +400,16 @@ namespace interviews {
       qq->unpublish();
     });
 
+  // Service to report which transitions are evaluated natively and which ones are evaluated by V8. Questionnaire designers can
+  // use it to simplify conditions before a campaign is launched, or to spot the conditions which fall back on V8 at runtime.
+
+  auto _questionnaire_transitions_report = service<srv_tag<"questionnaire_transitions_report">>
+    ([](const rfr<questionnaire_id>& q){
+      db::connector cn{dbname};
+      questionnaire_r qq = questionnaire::get(cn, q->_questionnaire_id).or_throw<questionnaire_does_not_exist>();
+      return make<questionnaire_transitions_report>(qq);
+    });
+
   // Interactive edition services below are not yet implemented.
   
   // Service to clone a questionnaire.
@@ -495,7 +506,9 @@ namespace interviews {
       // Let's fetch the questionnaire.
       questionnaire_r qq = questionnaire::get(cn, q->_questionnaire_id).or_throw<questionnaire_does_not_exist>();
       
-      return make<reply_id>(make<campaign>(*cn, q->_name, qq, q->_start, q->_duration, q->_interview_lifespan)->get_id());
+      campaign_r c = make<campaign>(*cn, q->_name, qq, q->_start, q->_duration, q->_interview_lifespan);
+      campaigns_statistics::prepare(c);
+      return make<reply_id>(c->get_id());
     });
  
   // Service to retrieve a campaign.
@@ -558,7 +571,47 @@ namespace interviews {
       // Let's fetch the campaign.
       campaign_r c = campaign::get(cn, q->_campaign_id).or_throw<campaign_does_not_exist>();
 
-      return make<reply_id>(make<interview>(cn, c)->get_id());
+      interview_r i = make<interview>(cn, c);
+      statistics_delta d;
+      d.add_state(interview::initiated, 1);
+      campaigns_statistics::record(c, d);
+      return make<reply_id>(i->get_id());
+    });
+
+  // Service to prepare a batch of interviews in a single call. The interviews are all written to the database when
+  // the request completes, instead of one request and one write per interview. Large panels are prepared in several
+  // calls.
+
+  constexpr size_t interview_prepare_bulk_max_size = 4096;
+
+  auto _interview_prepare_bulk = service<srv_tag<"interview_prepare_bulk">>
+    ([](const rfr<interview_prepare_bulk_payload>& q){
+      db::connector cn{dbname};
+      size_t n = q->_interviewee_ids.empty() ? q->_count.get() : q->_interviewee_ids.size();
+
+      if (n > interview_prepare_bulk_max_size){
+	throw interview_prepare_bulk_is_too_large();
+      }
+
+      // Let's fetch the campaign.
+      campaign_r c = campaign::get(cn, q->_campaign_id).or_throw<campaign_does_not_exist>();
+      interview_ids_r rtnd = make<interview_ids>();
+
+      if (q->_interviewee_ids.empty()){
+	for (size_t i = 0; i != n; ++i){
+	  rtnd->_interview_ids.push_back(make<interview>(cn, c)->get_id());
+	}
+      }
+      else{
+	for (const auto& iee: q->_interviewee_ids){
+	  rtnd->_interview_ids.push_back(make<interview>(cn, c, iee)->get_id());
+	}
+      }
+
+      statistics_delta d;
+      d.add_state(interview::initiated, n);
+      campaigns_statistics::record(c, d);
+      return rtnd;
     });
 
   // Service to obtain the languages supported by an interview.
@@ -601,8 +654,21 @@ namespace interviews {
       // Let's fetch the interview.
       interview_r i = interview::get(cn, q->_interview_id).or_throw<interview_does_not_exist>();
       i->check_active();
+      bool counted = i->is_counted();
+      statistics_delta d;
+
+      if (counted){
+	d.add_interview(*i, -1);
+      }
+      
       // This will fix the next question of the interview to the first question of the questionnaire. There is one.
       i->start(q->_interviewee_id, q->_interviewer_id, prologue.user, q->_language, prologue.request.get_client_ip(), q->_geo_location);
+
+      if (counted){
+	d.add_interview(*i, 1);
+	campaigns_statistics::record(i->get_campaign(), d);
+      }
+      
       return i->next_localized_question();
     });
  
@@ -643,6 +709,15 @@ namespace interviews {
 	throw interview_is_already_completed();
       }
 
+      // Appending to the log, the interview document is written only once in a while.
+      i->open_log();
+      bool counted = i->is_counted();
+      statistics_delta d;
+
+      if (counted){
+	d.add_interview(*i, -1);
+      }
+      
       localizations locs = i->next_question_localization();
       pair<time_t, time_t> el = i->calculate_elapsed_times();
 
@@ -657,7 +732,17 @@ namespace interviews {
 			    }),
 		 locs);
       
-      return i->move_ahead();
+      localized_question_r rtnd = i->move_ahead();
+
+      if (counted){
+	answer_p if_a = i->last_answer();
+	HX2A_ASSERT(if_a);
+	d.add_answer(**if_a, 1);
+	d.add_interview(*i, 1);
+	campaigns_statistics::record(i->get_campaign(), d);
+      }
+      
+      return rtnd;
     });
 
   // Service to revise an answer. If the transition is the same as before, the update is accepted without
@@ -683,6 +768,7 @@ namespace interviews {
 
       // It's not authorized to revise an answer on an interview which is not live.
       i->check_live();
+      i->compact();
 
       // We cannot use anchor ids for direct access as we need the iterator to perform revision/resection.
       // One pass done on the interview.
@@ -695,8 +781,15 @@ namespace interviews {
       localizations locs = ea->get_answer()->get_question_localization();
       // This does not require a pass on the interview.
       pair<time_t, time_t> el = i->calculate_elapsed_times();
+      // Revising might resect and restore many answers, the whole interview is recounted.
+      bool counted = i->is_counted();
+      statistics_delta d;
+
+      if (counted){
+	d.add_interview(*i, -1, true);
+      }
 
-      return std::visit(overloaded(
+      localized_question_p rtnd = std::visit(overloaded(
 				   [&](const question_localization_r& l) {
 				     // Regular question localization.
 				     return i->revise_answer(pos, query->_answer->make_answer(l, r.get_client_ip(), el.first, el.second));
@@ -706,6 +799,13 @@ namespace interviews {
 				     return i->revise_answer(pos, query->_answer->make_answer(l.localization, l.question, r.get_client_ip(), el.first, el.second));
 				   }),
 			locs);
+
+      if (counted){
+	d.add_interview(*i, 1, true);
+	campaigns_statistics::record(i->get_campaign(), d);
+      }
+      
+      return rtnd;
     });
 
   // Service to remove an interview.
@@ -716,7 +816,12 @@ namespace interviews {
 
       // Let's fetch the interview.
       interview_r i = interview::get(cn, q->_interview_id).or_throw<interview_does_not_exist>();
-
+      if (i->is_counted()){
+	statistics_delta d;
+	d.add_interview(*i, -1, true);
+	campaigns_statistics::record(i->get_campaign(), d);
+      }
+      
       i->unpublish();
     });
  
@@ -776,6 +881,57 @@ namespace interviews {
       return make<localized_interview_data>(i, q->_language);
     });
 
+  // Same for several interviews, typically of the same campaign. The question localizations are looked up and checked
+  // once per questionnaire instead of once per interview.
+
+  constexpr size_t interviews_localized_get_max_size = 256;
+
+  auto _interviews_localized_get = service<srv_tag<"interviews_localized_get">>
+    ([](const rfr<interview_ids_and_language_payload>& q){
+      db::connector cn{dbname};
+
+      if (q->_interview_ids.size() > interviews_localized_get_max_size){
+	throw interview_batch_is_too_large();
+      }
+
+      localized_interviews_data_r rtnd = make<localized_interviews_data>();
+      // The maps are keyed by question, so they are shared by interviews on the same questionnaire document.
+      ::std::unordered_map<const questionnaire*, questionnaire_localization_map_per_question> maps;
+      const questionnaire_localization_map_per_question no_map;
+
+      for (const auto& id: q->_interview_ids){
+	// Let's fetch the interview.
+	interview_r i = interview::get(cn, id).or_throw<interview_does_not_exist>();
+
+	// Taken in the language requested, no other localization needed.
+	if (i->get_language() == q->_language){
+	  rtnd->_interviews.push_back(make<localized_interview_data>(i, q->_language, no_map));
+	  continue;
+	}
+
+	const questionnaire* qq = &i->get_questionnaire().get();
+	auto f = maps.find(qq);
+
+	if (f == maps.cend()){
+	  f = maps.emplace(qq, localized_interview_data::make_localization_map(i, q->_language)).first;
+	}
+
+	rtnd->_interviews.push_back(make<localized_interview_data>(i, q->_language, f->second));
+      }
+
+      return rtnd;
+    });
+
+  // Service to obtain the statistics of a campaign, see statistics.hpp.
+
+  auto _campaign_statistics = service<srv_tag<"campaign_statistics">>
+    ([](const rfr<campaign_id>& q){
+      db::connector cn{dbname};
+      // Let's fetch the campaign.
+      campaign_r c = campaign::get(cn, q->_campaign_id).or_throw<campaign_does_not_exist>();
+      return make<campaign_statistics_data>(campaigns_statistics::read(c));
+    });
+
   // Paginated services to list interviews.
 
   struct campaign_id_adder
@@ -797,4 +953,25 @@ namespace interviews {
   >
   _interviews_by_campaign(config::get_id(dbname), config_name<"i_c">);
 
+  // Campaign export. The columns are requested once, then the rows are paginated over the same index as above.
+
+  auto _campaign_export_columns = service<srv_tag<"campaign_export_columns">>
+    ([](const rfr<campaign_id>& q){
+      db::connector cn{dbname};
+      // Let's fetch the campaign.
+      campaign_r c = campaign::get(cn, q->_campaign_id).or_throw<campaign_does_not_exist>();
+      return make<export_columns>(c->get_questionnaire());
+    });
+
+  paginated_services<
+    srv_tag<"interview_rows_by_campaign">,
+    interview,
+    projector<export_row>,
+    nil_prologue,
+    campaign_id,
+    campaign_id_adder,
+    json_leading_value_remover
+  >
+  _interview_rows_by_campaign(config::get_id(dbname), config_name<"i_c">);
+
 } // End namespace interviews.
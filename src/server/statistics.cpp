@@ -0,0 +1,402 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hx2a/db/connector.hpp"
+
+#include "interviews/statistics.hpp"
+
+namespace interviews {
+
+  void statistics_delta::add_answer(const answer& a, int64_t sign){
+    question_counts& qc = _questions[a.get_label()];
+    qc._answers += sign;
+    answer_body_r b = a.get_body();
+
+    if (answer_body_select* abs = dynamic_cast<answer_body_select*>(&b.get())){
+      qc._options[abs->get_choice()->get_index()]._count += sign;
+      return;
+    }
+
+    if (answer_body_multiple_choices* abmc = dynamic_cast<answer_body_multiple_choices*>(&b.get())){
+      bool ranked = dynamic_cast<answer_body_rank_at_most*>(abmc) || dynamic_cast<answer_body_rank_limit*>(abmc);
+      size_t position = 0;
+
+      for (auto i = abmc->selection_cbegin(), e = abmc->selection_cend(); i != e; ++i){
+	HX2A_ASSERT(*i);
+	option_counts& oc = qc._options[(*i)->get_index()];
+	oc._count += sign;
+
+	if (ranked){
+	  oc._ranks[position] += sign;
+	}
+
+	++position;
+      }
+    }
+  }
+
+  void statistics_delta::add_interview(const interview& i, int64_t sign, bool with_answers){
+    add_state(i.get_state(), sign);
+
+    if (!i.is_completed()){
+      // Null for interviews not started yet.
+      if (question_p nq = i.get_next_question()){
+	_questions[(*nq)->get_label()]._pending += sign;
+      }
+    }
+
+    if (!with_answers){
+      return;
+    }
+
+    auto add_entry = [&](const entry_r& e){
+      if (entry_answer* ea = dynamic_cast<entry_answer*>(&e.get())){
+	add_answer(*ea->get_answer(), sign);
+      }
+    };
+
+    for (auto hi = i.history_cbegin(), he = i.history_cend(); hi != he; ++hi){
+      HX2A_ASSERT(*hi);
+      add_entry(**hi);
+    }
+
+    if (interview_log_p if_l = i.get_log()){
+      interview_log_r l = *if_l;
+
+      for (auto li = l->entries_cbegin(), le = l->entries_cend(); li != le; ++li){
+	HX2A_ASSERT(*li);
+	add_entry(**li);
+      }
+    }
+  }
+
+  void statistics_delta::merge(const statistics_delta& d){
+    for (size_t s = 0; s <= interview::completed; ++s){
+      _states[s] += d._states[s];
+    }
+
+    for (const auto& [label, dqc]: d._questions){
+      question_counts& qc = _questions[label];
+      qc._answers += dqc._answers;
+      qc._pending += dqc._pending;
+
+      for (const auto& [index, doc]: dqc._options){
+	option_counts& oc = qc._options[index];
+	oc._count += doc._count;
+
+	for (const auto& [position, n]: doc._ranks){
+	  oc._ranks[position] += n;
+	}
+      }
+    }
+  }
+
+  rank_statistics_r option_statistics::get_rank(size_t position){
+    for (const auto& r: _ranks){
+      HX2A_ASSERT(r);
+
+      if (r->get_position() == position){
+	return *r;
+      }
+    }
+
+    rank_statistics_r r = make<rank_statistics>(position);
+    _ranks.push_back(r);
+    return r;
+  }
+
+  option_statistics_r question_statistics::get_option(size_t index){
+    for (const auto& o: _options){
+      HX2A_ASSERT(o);
+
+      if (o->get_index() == index){
+	return *o;
+      }
+    }
+
+    option_statistics_r o = make<option_statistics>(index);
+    _options.push_back(o);
+    return o;
+  }
+
+  void campaign_statistics::add(const statistics_delta& d){
+    _initiated = _initiated.get() + d.get_state(interview::initiated);
+    _ongoing = _ongoing.get() + d.get_state(interview::ongoing);
+    _completed = _completed.get() + d.get_state(interview::completed);
+    // Raw pointers, the question counters are owned by this.
+    ::std::unordered_map<string, question_statistics*> questions;
+
+    for (const auto& q: _questions){
+      HX2A_ASSERT(q);
+      question_statistics_r qs = *q;
+      questions.emplace(qs->get_label(), &qs.get());
+    }
+
+    for (const auto& [label, qc]: d.get_questions()){
+      question_statistics* qs;
+
+      if (auto f = questions.find(label); f != questions.cend()){
+	qs = f->second;
+      }
+      else{
+	question_statistics_r nqs = make<question_statistics>(label);
+	_questions.push_back(nqs);
+	qs = &nqs.get();
+      }
+
+      qs->add(qc._answers, qc._pending);
+
+      for (const auto& [index, oc]: qc._options){
+	option_statistics_r os = qs->get_option(index);
+	os->add(oc._count);
+
+	for (const auto& [position, n]: oc._ranks){
+	  os->get_rank(position)->add(n);
+	}
+      }
+    }
+  }
+
+  void campaign_statistics::sum_into(statistics_delta& d) const {
+    d.add_state(interview::initiated, _initiated);
+    d.add_state(interview::ongoing, _ongoing);
+    d.add_state(interview::completed, _completed);
+
+    for (const auto& q: _questions){
+      HX2A_ASSERT(q);
+      statistics_delta::question_counts& qc = d.get_question(q->get_label());
+      qc._answers += q->get_answers();
+      qc._pending += q->get_pending();
+
+      for (auto oi = q->options_cbegin(), oe = q->options_cend(); oi != oe; ++oi){
+	HX2A_ASSERT(*oi);
+	option_statistics_r os = **oi;
+	statistics_delta::option_counts& oc = qc._options[os->get_index()];
+	oc._count += os->get_count();
+
+	for (auto ri = os->ranks_cbegin(), re = os->ranks_cend(); ri != re; ++ri){
+	  HX2A_ASSERT(*ri);
+	  oc._ranks[(*ri)->get_position()] += (*ri)->get_count();
+	}
+      }
+    }
+  }
+
+  namespace {
+
+    // The number of counters documents per campaign. Bounds the number of processes adding to the same document.
+    constexpr size_t statistics_shards = 8;
+
+    // In seconds.
+    constexpr time_t statistics_flush_interval = 10;
+
+    struct accumulated_delta
+    {
+      accumulated_delta(time_t since, const doc_id& shard):
+	_since(since),
+	_shard(shard)
+      {
+      }
+
+      statistics_delta _delta;
+      // When the first difference not added yet was recorded.
+      time_t _since;
+      // The counters document to add the differences to, so that they can be added without the campaign.
+      doc_id _shard;
+    };
+
+    ::std::mutex statistics_mutex;
+    // By campaign identifier.
+    ::std::unordered_map<string, accumulated_delta> statistics_map;
+    // When the accumulated differences were last looked for due ones.
+    time_t statistics_last_scan = 0;
+
+    // The counters document of each campaign this process adds to. Derived from the host name and the process
+    // identifier, so that the processes of a host and the hosts of a cluster spread over the documents.
+    size_t make_shard(){
+      char host[256] = {};
+      gethostname(host, sizeof(host) - 1);
+      return (::std::hash<string>{}(host) ^ ::std::hash<pid_t>{}(getpid())) % statistics_shards;
+    }
+
+    const size_t statistics_shard = make_shard();
+
+    doc_id get_shard(const campaign_r& c){
+      HX2A_ASSERT(c->statistics_size() == statistics_shards);
+      auto i = c->statistics_cbegin();
+      ::std::advance(i, statistics_shard);
+      HX2A_ASSERT(*i);
+      return (*i)->get_id();
+    }
+
+    string make_key(const campaign_r& c){
+      ::std::ostringstream o;
+      o << c->get_id();
+      return o.str();
+    }
+
+    // Puts differences back, when they could not be added. Must be called under the lock.
+    void put_back(const string& key, const doc_id& shard, const statistics_delta& d){
+      auto [f, inserted] = statistics_map.try_emplace(key, time(), shard);
+      f->second._delta.merge(d);
+    }
+
+    // Must be called outside the lock, it writes a document. The counters document is written through a connector of
+    // its own, independently from the request. A request failing afterwards does not lose the differences, and a
+    // conflict with another process adding to the same document does not fail the request. The differences are put
+    // back to be added later instead.
+    void add_to_shard(const string& key, const doc_id& shard, const statistics_delta& d){
+      try{
+	db::connector cn{dbname};
+	campaign_statistics::get(cn, shard).or_throw<internal_error>()->add(d);
+      }
+      catch(...){
+	HX2A_LOG(error) << "Campaign " << key << " statistics could not be added, they will be retried.";
+	::std::lock_guard<::std::mutex> l(statistics_mutex);
+	put_back(key, shard, d);
+      }
+    }
+
+    struct due_delta
+    {
+      string _key;
+      doc_id _shard;
+      statistics_delta _delta;
+    };
+
+    using due_deltas_type = ::std::vector<due_delta>;
+
+    // Removes the differences accumulated for the campaign, if any. Must be called under the lock.
+    void take(const string& key, due_deltas_type& dds){
+      auto f = statistics_map.find(key);
+
+      if (f == statistics_map.end()){
+	return;
+      }
+
+      dds.push_back({f->first, f->second._shard, ::std::move(f->second._delta)});
+      statistics_map.erase(f);
+    }
+
+    // Same for all the campaigns whose first difference not added yet was recorded before the time given. Must be
+    // called under the lock.
+    void take_before(time_t t, due_deltas_type& dds){
+      for (auto i = statistics_map.begin(), e = statistics_map.end(); i != e;){
+	if (i->second._since > t){
+	  ++i;
+	  continue;
+	}
+
+	dds.push_back({i->first, i->second._shard, ::std::move(i->second._delta)});
+	i = statistics_map.erase(i);
+      }
+    }
+
+    void add_to_shards(const due_deltas_type& dds){
+      for (const auto& dd: dds){
+	add_to_shard(dd._key, dd._shard, dd._delta);
+      }
+    }
+
+    // Adds the differences still accumulated when the process exits normally. Destroyed before the map and the mutex
+    // above.
+    struct statistics_exit_flush
+    {
+      ~statistics_exit_flush(){
+	due_deltas_type dds;
+
+	{
+	  ::std::lock_guard<::std::mutex> l(statistics_mutex);
+	  take_before(::std::numeric_limits<time_t>::max(), dds);
+	}
+
+	add_to_shards(dds);
+      }
+    };
+
+    statistics_exit_flush statistics_exit_flush_instance;
+
+  } // End anonymous namespace.
+
+  void campaigns_statistics::prepare(const campaign_r& c){
+    HX2A_ASSERT(!c->statistics_size());
+
+    for (size_t n = 0; n != statistics_shards; ++n){
+      c->push_statistics_back(make<campaign_statistics>(*c->get_home(), c));
+    }
+  }
+
+  void campaigns_statistics::record(const campaign_r& c, const statistics_delta& d){
+    // Campaigns created before the counters existed have none.
+    if (!c->statistics_size()){
+      return;
+    }
+    
+    string key = make_key(c);
+    due_deltas_type dds;
+
+    {
+      ::std::lock_guard<::std::mutex> l(statistics_mutex);
+      time_t now = time();
+      auto f = statistics_map.find(key);
+
+      if (f == statistics_map.end()){
+	f = statistics_map.try_emplace(key, now, get_shard(c)).first;
+      }
+
+      f->second._delta.merge(d);
+
+      // Once a second at most, the differences of all the campaigns recorded long enough ago are added, so that the
+      // campaigns going quiet are not left behind.
+      if (now == statistics_last_scan){
+	return;
+      }
+
+      statistics_last_scan = now;
+      take_before(now - statistics_flush_interval, dds);
+    }
+
+    add_to_shards(dds);
+  }
+
+  void campaigns_statistics::flush(const campaign_r& c){
+    if (!c->statistics_size()){
+      return;
+    }
+    
+    due_deltas_type dds;
+
+    {
+      ::std::lock_guard<::std::mutex> l(statistics_mutex);
+      take(make_key(c), dds);
+    }
+
+    add_to_shards(dds);
+  }
+
+  statistics_delta campaigns_statistics::read(const campaign_r& c){
+    flush(c);
+    statistics_delta rtnd;
+
+    for (auto i = c->statistics_cbegin(), e = c->statistics_cend(); i != e; ++i){
+      HX2A_ASSERT(*i);
+      (*i)->sum_into(rtnd);
+    }
+
+    return rtnd;
+  }
+
+} // End namespace interviews.
@@ -0,0 +1,126 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+// Native evaluation of transition conditions, see conditions.hpp. Each case gives the condition, the arguments as JSON
+// text, and what is expected: the condition not being compiled natively, the evaluation falling back on V8, or the
+// result of json::is_true on the value V8 would return.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "interviews/conditions.hpp"
+
+#include "tests.hpp"
+
+using namespace interviews;
+
+namespace {
+
+  enum outcome_t {
+		  not_compiled,
+		  fallback,
+		  is_true,
+		  is_false
+  };
+
+  struct condition_case
+  {
+    const char* code;
+    // The values of a and b.
+    const char* a;
+    const char* b;
+    outcome_t outcome;
+  };
+
+  const condition_case condition_cases[] = {
+    // Members, indices and comparisons.
+    {"a.choice.index == 2", R"({"choice":{"index":2}})", "null", is_true},
+    {"a.choice.index === 3", R"({"choice":{"index":2}})", "null", is_false},
+    {"a.input != 'yes' && !b", R"({"input":"no"})", "false", is_true},
+    {"a.choices.length > 1", R"({"choices":[{"index":0},{"index":3}]})", "null", is_true},
+    {"(a[1] === 2) || b", "[1,2]", "false", is_true},
+    {"a < b", R"("abc")", R"("abd")", is_true},
+    {"b.length == 3", "null", R"("abc")", is_true},
+    {"-a < 0", "1", "null", is_true},
+    {"a && b", "1", "0", is_false},
+    {"a === a", R"({"x":1})", "null", is_true},
+    {"a.missing == null", "{}", "null", is_true},
+    {"a == undefined", "null", "null", is_true},
+    {"a == 2;", "2", "null", is_true},
+    // Type coercions are left to V8.
+    {"a == '2'", "2", "null", fallback},
+    {"a < '3'", "2", "null", fallback},
+    {"a == true", "1", "null", fallback},
+    {"-a", R"("1")", "null", fallback},
+    // Non ASCII strings have UTF-16 lengths and orderings.
+    {"a < b", R"("é")", R"("e")", fallback},
+    {"a.length == 1", R"("é")", "null", fallback},
+    // Prototype members.
+    {"a.constructor", "{}", "null", fallback},
+    {"a.toString == undefined", "{}", "null", fallback},
+    {"a.__proto__ == 1", R"({"__proto__":1})", "null", fallback},
+    {"a.map", "[]", "null", fallback},
+    {"a.x", "null", "null", fallback},
+    // Indices.
+    {"a[5] === undefined", "[1,2]", "null", is_true},
+    {"a[5]", "[1,2]", "null", fallback},
+    {"a[-1] == null", "[1,2]", "null", fallback},
+    {"a[0.5] == null", "[1,2]", "null", fallback},
+    {"a['0'] == 1", "[1,2]", "null", fallback},
+    {"a[0] == 1", R"({"0":1})", "null", fallback},
+    // Outside of the subset.
+    {"a[01] == 2", "[1,2]", "null", not_compiled},
+    {"a == 010", "8", "null", not_compiled},
+    {"a == 0x10", "16", "null", not_compiled},
+    {"a == '\\u0041'", R"("A")", "null", not_compiled},
+    {"c == 1", "1", "null", not_compiled},
+    {"Math.max(a, b) > 1", "1", "2", not_compiled},
+    {"a = 1", "1", "null", not_compiled},
+    {"a == 1; b", "1", "null", not_compiled}
+  };
+
+  const char* outcome_name(outcome_t o){
+    switch (o){
+    case not_compiled: return "not compiled";
+    case fallback: return "fallback";
+    case is_true: return "true";
+    default: return "false";
+    }
+  }
+
+  outcome_t run(const condition_case& c){
+    ::std::optional<expression> e = expression::compile(c.code, {"a", "b"});
+
+    if (!e){
+      return not_compiled;
+    }
+
+    expression::arguments args{json::value::read<no_line_count, pretty>(c.a), json::value::read<no_line_count, pretty>(c.b)};
+    ::std::optional<bool> r = e->evaluate(args);
+
+    if (!r){
+      return fallback;
+    }
+
+    return *r ? is_true : is_false;
+  }
+
+} // End anonymous namespace.
+
+int test_conditions(){
+  int failures = 0;
+
+  for (const auto& c: condition_cases){
+    outcome_t o = run(c);
+
+    if (o != c.outcome){
+      ::std::cerr << "Condition " << c.code << " with a=" << c.a << " and b=" << c.b << ": expected " << outcome_name(c.outcome) << ", got " << outcome_name(o) << '.' << ::std::endl;
+      ++failures;
+    }
+  }
+
+  return failures;
+}
@@ -0,0 +1,116 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+// Native application of loop operands, see loop_operand.hpp. Each case gives the operand, the localized answer to the
+// operand question as JSON text, and what is expected: the operand not being a path, the application falling back on
+// V8, or the value assigned to R as JSON text.
+
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include "interviews/loop_operand.hpp"
+
+#include "tests.hpp"
+
+using namespace interviews;
+
+namespace {
+
+  constexpr const char* not_a_path = "not a path";
+  constexpr const char* fallback = "fallback";
+
+  struct loop_operand_case
+  {
+    const char* operand;
+    // The localized answer to the question hh.
+    const char* answer;
+    // The value assigned to R, or one of the above.
+    const char* outcome;
+  };
+
+  const loop_operand_case loop_operand_cases[] = {
+    // Paths.
+    {"R=hh.choices", R"({"choices":[{"index":0},{"index":2}]})", R"([{"index":0},{"index":2}])"},
+    {" R = hh . choices ; ", R"({"choices":[1,2]})", "[1,2]"},
+    {"R=hh.choices[1]", R"({"choices":[1,[3,4]]})", "[3,4]"},
+    {"R=hh[0][1]", "[[1,2]]", "2"},
+    {"R=hh", R"({"input":"a"})", R"({"input":"a"})"},
+    // Out of range indices give undefined, assigned as null.
+    {"R=hh.choices[5]", R"({"choices":[1]})", "null"},
+    {"R=hh[123456789]", "[]", "null"},
+    // Prototype members, array and string properties, and TypeErrors are left to V8.
+    {"R=hh.missing", "{}", fallback},
+    {"R=hh.toString", "{}", fallback},
+    {"R=hh.length", "[1,2]", fallback},
+    {"R=hh.input.length", R"({"input":"abc"})", fallback},
+    {"R=hh.choices[5].index", R"({"choices":[1]})", fallback},
+    {"R=hh.a", "null", fallback},
+    {"R=hh[0]", R"({"0":1})", fallback},
+    // Not paths.
+    {"R=hh.__proto__", R"({"__proto__":[1]})", not_a_path},
+    {"R=hh[01]", "[1,2]", not_a_path},
+    {"R=hh[0x1]", "[1,2]", not_a_path},
+    {"R=hh[1234567890]", "[]", not_a_path},
+    {"R=hh[-1]", "[1,2]", not_a_path},
+    {"R=hh['0']", "[1,2]", not_a_path},
+    {"R=hh.choices.map(c=>c.index)", R"({"choices":[]})", not_a_path},
+    {"R==hh", "[]", not_a_path},
+    {"S=hh", "[]", not_a_path},
+    {"R=hh;R=[]", "[]", not_a_path},
+    {"R=[1,2]", "[]", not_a_path}
+  };
+
+  string run(const loop_operand_case& c){
+    ::std::optional<loop_operand_path> p = loop_operand_path::parse(c.operand);
+
+    if (!p){
+      return not_a_path;
+    }
+
+    if (p->get_root() != "hh"){
+      return "root " + p->get_root();
+    }
+
+    ::std::optional<json::value> v = p->apply(json::value::read<no_line_count, pretty>(c.answer));
+
+    if (!v){
+      return fallback;
+    }
+
+    ::std::ostringstream o;
+    o << *v;
+    return o.str();
+  }
+
+  // Expected values are written compactly, they are reformatted the same way as the results.
+  string format(const char* outcome){
+    if (string(outcome) == not_a_path || string(outcome) == fallback){
+      return outcome;
+    }
+
+    ::std::ostringstream o;
+    o << json::value::read<no_line_count, pretty>(outcome);
+    return o.str();
+  }
+
+} // End anonymous namespace.
+
+int test_loop_operand(){
+  int failures = 0;
+
+  for (const auto& c: loop_operand_cases){
+    string o = run(c);
+    string e = format(c.outcome);
+
+    if (o != e){
+      ::std::cerr << "Loop operand " << c.operand << " on " << c.answer << ": expected " << e << ", got " << o << '.' << ::std::endl;
+      ++failures;
+    }
+  }
+
+  return failures;
+}
@@ -0,0 +1,37 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+// Test entry point, see the README. Exits with a non zero status if any case fails.
+
+#include <iostream>
+
+#include "tests.hpp"
+
+namespace {
+
+  struct test
+  {
+    const char* name;
+    int (*run)();
+  };
+
+  const test tests[] = {
+    {"conditions", test_conditions},
+    {"loop_operand", test_loop_operand}
+  };
+
+} // End anonymous namespace.
+
+int main(){
+  int failures = 0;
+
+  for (const auto& t: tests){
+    int f = t.run();
+    ::std::cout << t.name << ": " << (f ? "FAILED" : "passed") << ::std::endl;
+    failures += f;
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+//
+// Copyright Metaspex - 2023
+// mailto:admin@metaspex.com
+//
+
+#ifndef HX2A_INTERVIEWS_TESTS_HPP
+#define HX2A_INTERVIEWS_TESTS_HPP
+
+// The table-driven tests of the native evaluations, run by test/main.cpp. Each returns its number of failures, and
+// reports them on the standard error.
+
+int test_conditions();
+
+int test_loop_operand();
+
+#endif